@@ -0,0 +1,104 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace Arena {
+
+namespace {
+
+size_t aligned(size_t bytes) {
+   return (bytes + alignment - 1) / alignment * alignment;
+}
+
+}
+
+int Plan::add_buffer(size_t bytes, bool keep) {
+   buffers.push_back({aligned(bytes), keep, 0, {}});
+   return (int) buffers.size() - 1;
+}
+
+int Plan::add_stage(const std::vector<int> &accessed, const std::vector<int> &dependencies) {
+   int stage = (int) ancestors.size();
+   std::vector<bool> stage_ancestors(stage, false);
+   for (int dependency: dependencies) {
+      stage_ancestors[dependency] = true;
+      for (int i = 0; i < dependency; i++) {
+         if (ancestors[dependency][i])
+            stage_ancestors[i] = true;
+      }
+   }
+   ancestors.push_back(std::move(stage_ancestors));
+   for (int buffer: accessed)
+      buffers[buffer].stages.push_back(stage);
+   return stage;
+}
+
+int Plan::add_stage(const std::vector<int> &accessed) {
+   int stage = (int) ancestors.size();
+   std::vector<int> dependencies;
+   if (stage > 0)
+      dependencies.push_back(stage - 1);
+   return add_stage(accessed, dependencies);
+}
+
+bool Plan::ordered(const std::vector<int> &first, const std::vector<int> &second) const {
+   for (int s: first) {
+      for (int t: second) {
+         if (t <= s || !ancestors[t][s])
+            return false;
+      }
+   }
+   return true;
+}
+
+bool Plan::conflict(const Buffer &a, const Buffer &b) const {
+   if (a.keep || b.keep || a.stages.empty() || b.stages.empty())
+      return true;
+   return !ordered(a.stages, b.stages) && !ordered(b.stages, a.stages);
+}
+
+void Plan::place() {
+   std::vector<int> order(buffers.size());
+   std::iota(order.begin(), order.end(), 0);
+   std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return buffers[a].bytes > buffers[b].bytes; });
+   slab_size = 0;
+   std::vector<int> placed;
+   for (int index: order) {
+      Buffer &buffer = buffers[index];
+      // Byte ranges taken by the placed buffers it conflicts with, by offset
+      std::vector<std::pair<size_t, size_t>> taken;
+      for (int other: placed) {
+         if (conflict(buffer, buffers[other]))
+            taken.emplace_back(buffers[other].offset, buffers[other].offset + buffers[other].bytes);
+      }
+      std::sort(taken.begin(), taken.end());
+      size_t offset = 0;
+      for (const auto &range: taken) {
+         if (range.first >= offset + buffer.bytes)
+            break;
+         offset = std::max(offset, range.second);
+      }
+      buffer.offset = offset;
+      slab_size = std::max(slab_size, offset + buffer.bytes);
+      placed.push_back(index);
+   }
+}
+
+size_t Plan::unshared_size() const {
+   size_t bytes = 0;
+   for (const Buffer &buffer: buffers)
+      bytes += buffer.bytes;
+   return bytes;
+}
+
+void Slab::resize(size_t new_bytes) {
+   if (new_bytes == bytes)
+      return;
+   data.reset();
+   if (new_bytes > 0)
+      data.reset(static_cast<uint8_t *>(::operator new(new_bytes, std::align_val_t(alignment))));
+   bytes = new_bytes;
+}
+
+}
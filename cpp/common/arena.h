@@ -0,0 +1,83 @@
+#ifndef BARCODE_SEGMENTATION_ARENA_H
+#define BARCODE_SEGMENTATION_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+#include <HalideBuffer.h>
+
+// Intermediate buffers of a pipeline laid out in one slab, the buffers that are never live at the same time sharing
+// their bytes. Lifetimes come from the stages: two buffers conflict unless every stage accessing one of them is
+// ordered by the dependencies before every stage accessing the other, so neither a later stage nor a concurrent one
+// finds its input overwritten.
+namespace Arena {
+
+// Offsets and slab size are in bytes, aligned to cache lines
+const size_t alignment = 64;
+
+class Plan {
+public:
+   // Adds a buffer and returns its index. A kept buffer holds its content from one run to the next, so it shares its
+   // bytes with no other buffer. So does a buffer no stage accesses
+   int add_buffer(size_t bytes, bool keep = false);
+
+   // Adds a stage accessing the buffers, run once its dependencies are done, and returns its index
+   int add_stage(const std::vector<int> &buffers, const std::vector<int> &dependencies);
+   // Same, the stage running after every stage added before it
+   int add_stage(const std::vector<int> &buffers);
+
+   // Places the buffers, largest first, each at the lowest offset clear of the buffers it conflicts with
+   void place();
+
+   size_t offset(int buffer) const { return buffers[buffer].offset; }
+   // Bytes of the slab once placed, and of the buffers allocated apart
+   size_t size() const { return slab_size; }
+   size_t unshared_size() const;
+
+private:
+   struct Buffer {
+      size_t bytes;
+      bool keep;
+      size_t offset;
+      // Stages accessing the buffer
+      std::vector<int> stages;
+   };
+
+   bool conflict(const Buffer &a, const Buffer &b) const;
+   // Whether every stage in `first` runs before every stage in `second`
+   bool ordered(const std::vector<int> &first, const std::vector<int> &second) const;
+
+   std::vector<Buffer> buffers;
+   // Stages that run before each stage, directly or not
+   std::vector<std::vector<bool>> ancestors;
+   size_t slab_size = 0;
+};
+
+// Memory of a plan
+class Slab {
+public:
+   // Reallocates when the size changes, the content is then lost along with the buffers taken before
+   void resize(size_t bytes);
+
+   size_t size() const { return bytes; }
+
+   // Buffer of the given extents over the bytes of a buffer of the plan. It does not own them
+   template<typename T>
+   Halide::Runtime::Buffer<T> buffer(const Plan &plan, int index, const std::vector<int> &extents) {
+      return Halide::Runtime::Buffer<T>(reinterpret_cast<T *>(data.get() + plan.offset(index)), extents);
+   }
+
+private:
+   struct Free {
+      void operator()(uint8_t *memory) const { ::operator delete(memory, std::align_val_t(alignment)); }
+   };
+
+   std::unique_ptr<uint8_t, Free> data;
+   size_t bytes = 0;
+};
+
+}
+
+#endif //BARCODE_SEGMENTATION_ARENA_H
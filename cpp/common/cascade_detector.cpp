@@ -0,0 +1,46 @@
+#include "cascade_detector.h"
+
+#include <cmath>
+
+namespace Cascade {
+
+// Side of the squares of PDRT 32, laid without overlap
+const int coarse_tile_size = 32;
+
+void Context::screen(Halide::Runtime::Buffer<uint8_t> &input, float coarse_score, int margin) {
+   const Detections::Planes &planes = coarse.run_planes(input);
+   int min_score = (int) std::ceil(coarse_score * Detections::score_scale);
+   rois.clear();
+   for (int y = 0; y < planes.scores.dim(1).extent(); y++) {
+      int x = 0;
+      while (x < planes.scores.dim(0).extent()) {
+         if (planes.scores(x, y, 0) < min_score) {
+            x++;
+            continue;
+         }
+         int begin = x;
+         while (x < planes.scores.dim(0).extent() && planes.scores(x, y, 0) >= min_score)
+            x++;
+         rois.push_back({begin * coarse_tile_size - margin, y * coarse_tile_size - margin,
+                         (x - begin) * coarse_tile_size + 2 * margin, coarse_tile_size + 2 * margin});
+      }
+   }
+}
+
+Halide::Runtime::Buffer<uint8_t> Context::run_ps(Halide::Runtime::Buffer<uint8_t> &input, float coarse_score,
+                                                 int margin) {
+   screen(input, coarse_score, margin);
+   return ps.run_roi(input, rois);
+}
+
+Halide::Runtime::Buffer<uint8_t> Context::run_mdd(Halide::Runtime::Buffer<uint8_t> &input,
+                                                  double w_orig_3, double w_orig_2, double w_orig_1,
+                                                  double w_orig_0, double w_new_3, double w_new_2,
+                                                  double w_new_1, double w_new_0, double threshold,
+                                                  float coarse_score, int margin) {
+   screen(input, coarse_score, margin);
+   return mdd.run_roi(input, rois, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0,
+                      threshold);
+}
+
+}
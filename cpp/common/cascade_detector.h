@@ -0,0 +1,41 @@
+#ifndef BARCODE_SEGMENTATION_CASCADE_DETECTOR_H
+#define BARCODE_SEGMENTATION_CASCADE_DETECTOR_H
+
+#include <vector>
+#include <HalideRuntime.h>
+#include <HalideBuffer.h>
+#include "roi.h"
+#include "multiscale_domain_detector_drt.h"
+#include "partial_strided_drt.h"
+#include "partial_drt32.h"
+
+namespace Cascade {
+
+// Coarse-to-fine detector. PDRT 32 screens the frame in 32x32 tiles, and the PS DRT or the MDD DRT only refines the
+// tiles whose coarse score reaches coarse_score (1 being the PDRT 32 threshold), grown by `margin` pixels. The output
+// has the size and layout of the refining detector's one, and is zero outside the candidate tiles.
+class Context {
+public:
+   Halide::Runtime::Buffer<uint8_t> run_ps(Halide::Runtime::Buffer<uint8_t> &input, float coarse_score = 0.5f,
+                                           int margin = 32);
+   Halide::Runtime::Buffer<uint8_t> run_mdd(Halide::Runtime::Buffer<uint8_t> &input,
+                                            double w_orig_3 = 1.0, double w_orig_2 = 1.0, double w_orig_1 = 1.0,
+                                            double w_orig_0 = 1.0, double w_new_3 = 1.0, double w_new_2 = 1.0,
+                                            double w_new_1 = 1.0, double w_new_0 = 1.0, double threshold = 0.05,
+                                            float coarse_score = 0.5f, int margin = 32);
+   // Regions refined by the last call, one per run of consecutive candidate tiles along a row
+   const std::vector<ROI::Rect> &candidates() const { return rois; }
+
+private:
+   // Runs PDRT 32 and fills `rois` with the candidate tiles
+   void screen(Halide::Runtime::Buffer<uint8_t> &input, float coarse_score, int margin);
+
+   PDRT32::Context coarse;
+   PSDRT::Context ps;
+   MDDDRT::Context mdd;
+   std::vector<ROI::Rect> rois;
+};
+
+}
+
+#endif //BARCODE_SEGMENTATION_CASCADE_DETECTOR_H
@@ -0,0 +1,95 @@
+#include "cpu_dispatch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <HalideRuntime.h>
+
+namespace CpuDispatch {
+
+namespace {
+
+std::atomic<int> max_variant{(int) Variant::avx512};
+
+bool has_feature(int count, const uint64_t *features, halide_target_feature_t feature) {
+   int word = feature / 64;
+   return word < count && ((features[word] >> (feature % 64)) & 1);
+}
+
+// Called by the multi-target wrappers for each variant, most capable first. The variants above the limit are
+// refused, the others go through Halide's own cpuid check
+int can_use_target_features(int count, const uint64_t *features) {
+   Variant variant = (Variant) max_variant.load(std::memory_order_relaxed);
+   if (variant < Variant::avx512 && (has_feature(count, features, halide_target_feature_avx512) ||
+                                     has_feature(count, features, halide_target_feature_avx512_skylake)))
+      return 0;
+   if (variant < Variant::avx2 && has_feature(count, features, halide_target_feature_avx2))
+      return 0;
+   return halide_default_can_use_target_features(count, features);
+}
+
+struct Install {
+   Install() {
+      halide_set_custom_can_use_target_features(can_use_target_features);
+      const char *isa = std::getenv("BARCODE_SEGMENTATION_ISA");
+      if (isa == nullptr)
+         return;
+      for (Variant variant: {Variant::sse41, Variant::avx2, Variant::avx512}) {
+         if (!strcmp(isa, name(variant)))
+            limit(variant);
+      }
+   }
+} install;
+
+}
+
+Variant detected() {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+   static const Variant variant = [] {
+      __builtin_cpu_init();
+      // The features of Halide's avx512_skylake target
+      if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd") &&
+          __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq") &&
+          __builtin_cpu_supports("avx512vl"))
+         return Variant::avx512;
+      if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+         return Variant::avx2;
+      // The SSE4.1 variant is the fallback of the multi-target wrappers
+      return Variant::sse41;
+   }();
+   return variant;
+#else
+   return Variant::host;
+#endif
+}
+
+Variant selected() {
+#ifdef WITH_MULTI_ISA
+   return std::min(detected(), (Variant) max_variant.load(std::memory_order_relaxed));
+#else
+   return Variant::host;
+#endif
+}
+
+void limit(Variant variant) {
+   // The SSE4.1 variant always runs, so lower limits mean the same
+   max_variant.store((int) std::max(variant, Variant::sse41), std::memory_order_relaxed);
+}
+
+const char *name(Variant variant) {
+   switch (variant) {
+      case Variant::sse41:
+         return "sse41";
+      case Variant::avx2:
+         return "avx2";
+      case Variant::avx512:
+         return "avx512";
+      default:
+         return "host";
+   }
+}
+
+}
@@ -0,0 +1,31 @@
+#ifndef BARCODE_SEGMENTATION_CPU_DISPATCH_H
+#define BARCODE_SEGMENTATION_CPU_DISPATCH_H
+
+// x86-64 feature levels of the detector libraries, built with -DWITH_MULTI_ISA
+// (-DBARCODE_SEGMENTATION_MULTI_ISA=ON in CMake). Every stage is then compiled for SSE4.1, AVX2 and AVX-512, and
+// Halide's multi-target wrapper runs the most capable variant the CPU supports, as cpuid reports it. Without it the
+// stages are compiled for the build machine only, and selected() is host.
+namespace CpuDispatch {
+
+enum class Variant {
+   host,
+   sse41,
+   avx2,
+   avx512
+};
+
+// Most capable level the CPU supports. host on other architectures
+Variant detected();
+
+// Level the stages run at: the detected one, lowered to the limit if one is set
+Variant selected();
+
+// Keeps the stages at or below a level, e.g. to compare the variants on one machine. Also set before main() from the
+// BARCODE_SEGMENTATION_ISA environment variable (sse41, avx2 or avx512)
+void limit(Variant variant);
+
+const char *name(Variant variant);
+
+}
+
+#endif //BARCODE_SEGMENTATION_CPU_DISPATCH_H
@@ -0,0 +1,346 @@
+#include "detection_server.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "multiscale_domain_detector_drt.h"
+#include "partial_strided_drt.h"
+#include "partial_drt2.h"
+#include "partial_drt32.h"
+
+namespace DetectionServer {
+
+namespace {
+
+// Latencies kept per stream for the percentiles
+const size_t latency_window = 1024;
+
+// Weights and threshold used by python/camera.py
+const double w_orig[4] = {0.05, 0.527, 0.33, 0.76};
+const double w_new[4] = {0.84, 0.84, 1.16, 3.47};
+const double mdd_threshold = 1;
+
+double milliseconds(Clock::duration duration) {
+   return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+Clock::time_point deadline(const StreamOptions &options, Clock::time_point submitted) {
+   return submitted + std::chrono::duration_cast<Clock::duration>(
+         std::chrono::duration<double, std::milli>(options.deadline_ms));
+}
+
+// Nearest rank percentile of sorted samples
+double percentile(const std::vector<double> &sorted, double p) {
+   size_t rank = (size_t) std::ceil(p * sorted.size());
+   return sorted[std::min(std::max(rank, (size_t) 1), sorted.size()) - 1];
+}
+
+// Oldest to newest of the latencies kept in a ring
+std::vector<double> window(const std::vector<double> &ring, size_t n_recorded) {
+   if (n_recorded <= ring.size())
+      return std::vector<double>(ring.begin(), ring.begin() + n_recorded);
+   size_t oldest = n_recorded % ring.size();
+   std::vector<double> latencies(ring.begin() + oldest, ring.end());
+   latencies.insert(latencies.end(), ring.begin(), ring.begin() + oldest);
+   return latencies;
+}
+
+// Throughput and latency percentiles added to the counters
+Metrics summarize(Metrics metrics, Clock::time_point first_submitted, std::vector<double> latencies) {
+   if (metrics.submitted > 0)
+      metrics.fps = metrics.processed / std::max(1e-9, milliseconds(Clock::now() - first_submitted) * 1e-3);
+   if (!latencies.empty()) {
+      for (double latency: latencies)
+         metrics.latency_mean += latency / latencies.size();
+      std::sort(latencies.begin(), latencies.end());
+      metrics.latency_p50 = percentile(latencies, 0.5);
+      metrics.latency_p95 = percentile(latencies, 0.95);
+      metrics.latency_p99 = percentile(latencies, 0.99);
+      metrics.latency_max = latencies.back();
+   }
+   return metrics;
+}
+
+// Empty when the normalization value is out of range
+template<typename C>
+std::function<const std::vector<Detections::Detection> &(Halide::Runtime::Buffer<uint8_t> &)>
+partial_detector(const StreamOptions &options) {
+   auto context = std::make_shared<C>();
+   if (!context->set_normalization(options.normalization, options.normalization_value))
+      return nullptr;
+   int min_area = options.min_area;
+   return [context, min_area](Halide::Runtime::Buffer<uint8_t> &frame) -> const std::vector<Detections::Detection> & {
+      return context->detect(frame, min_area);
+   };
+}
+
+}
+
+Server::Server(int n_workers, Callback callback) : callback(std::move(callback)) {
+   if (n_workers <= 0)
+      n_workers = std::max(1, (int) std::thread::hardware_concurrency());
+   for (int i = 0; i < n_workers; i++)
+      workers.emplace_back([this]() { work(); });
+}
+
+Server::~Server() {
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+   }
+   work_ready.notify_all();
+   for (std::thread &worker: workers)
+      worker.join();
+}
+
+int Server::add_stream(const StreamOptions &options) {
+   if (options.width <= 0 || options.height <= 0 || options.depth < 1 || options.deadline_ms <= 0)
+      return -1;
+   auto stream = std::make_unique<Stream>();
+   stream->options = options;
+   switch (options.detector) {
+      case Detector::mdd: {
+         auto context = std::make_shared<MDDDRT::Context>();
+         int min_area = options.min_area;
+         stream->detect = [context, min_area](Halide::Runtime::Buffer<uint8_t> &frame)
+               -> const std::vector<Detections::Detection> & {
+            return context->detect(frame, w_orig[0], w_orig[1], w_orig[2], w_orig[3], w_new[0], w_new[1], w_new[2],
+                                   w_new[3], mdd_threshold, min_area);
+         };
+         break;
+      }
+      case Detector::ps:
+         stream->detect = partial_detector<PSDRT::Context>(options);
+         break;
+      case Detector::pdrt2:
+         stream->detect = partial_detector<PDRT2::Context>(options);
+         break;
+      case Detector::pdrt32:
+         stream->detect = partial_detector<PDRT32::Context>(options);
+         break;
+      default:
+         return -1;
+   }
+   if (!stream->detect)
+      return -1;
+   // The waiting frames, the one being processed and one being copied in by submit()
+   int n_slots = options.depth + 2;
+   for (int i = 0; i < n_slots; i++) {
+      stream->slots.push_back({Halide::Runtime::Buffer<uint8_t>(options.width, options.height), {}, 0});
+      stream->free_slots.push_back(i);
+   }
+   stream->latencies.resize(latency_window);
+   std::lock_guard<std::mutex> lock(mutex);
+   streams.push_back(std::move(stream));
+   return (int) streams.size() - 1;
+}
+
+int64_t Server::submit(int stream_index, const Halide::Runtime::Buffer<uint8_t> &frame) {
+   std::unique_lock<std::mutex> lock(mutex);
+   if (stream_index < 0 || stream_index >= (int) streams.size())
+      return -1;
+   Stream &stream = *streams[stream_index];
+   if (frame.width() != stream.options.width || frame.height() != stream.options.height)
+      return -1;
+   Clock::time_point now = Clock::now();
+   if (stream.metrics.submitted++ == 0)
+      stream.first_submitted = now;
+   int64_t sequence = stream.next_sequence++;
+   // Latest frame wins: the oldest waiting ones make room, the frames being copied in counting as waiting
+   while (!stream.waiting.empty() && (int) stream.waiting.size() + stream.copying >= stream.options.depth) {
+      stream.free_slots.push_back(stream.waiting.front());
+      stream.waiting.pop_front();
+      stream.metrics.dropped++;
+   }
+   if (stream.free_slots.empty()) {
+      // Every slot is being processed or copied into by other submitters
+      stream.metrics.dropped++;
+      return sequence;
+   }
+   int slot = stream.free_slots.back();
+   stream.free_slots.pop_back();
+   stream.slots[slot].submitted = now;
+   stream.slots[slot].sequence = sequence;
+   stream.copying++;
+
+   // The copy does not hold up the workers and the other streams
+   lock.unlock();
+   stream.slots[slot].frame.copy_from(frame);
+   lock.lock();
+   stream.copying--;
+   // Other submitters may have filled the stream meanwhile, and their copies may finish first: the frame goes
+   // behind the older waiting ones, and the oldest make room again, this one included if it is the oldest
+   auto position = std::upper_bound(stream.waiting.begin(), stream.waiting.end(), sequence,
+                                    [&stream](int64_t frame_sequence, int waiting_slot) {
+                                       return frame_sequence < stream.slots[waiting_slot].sequence;
+                                    });
+   stream.waiting.insert(position, slot);
+   while ((int) stream.waiting.size() > stream.options.depth) {
+      stream.free_slots.push_back(stream.waiting.front());
+      stream.waiting.pop_front();
+      stream.metrics.dropped++;
+   }
+   lock.unlock();
+   work_ready.notify_one();
+   return sequence;
+}
+
+int Server::next_stream() const {
+   // Under overload every stream would be late: those are served in turn, ahead of the ones still on time
+   Clock::time_point now = Clock::now();
+   int best = -1;
+   bool best_late = false;
+   Clock::time_point best_key;
+   for (size_t i = 0; i < streams.size(); i++) {
+      const Stream &stream = *streams[i];
+      if (stream.busy || stream.waiting.empty())
+         continue;
+      Clock::time_point frame_deadline = deadline(stream.options, stream.slots[stream.waiting.front()].submitted);
+      bool late = frame_deadline < now;
+      Clock::time_point key = late ? stream.last_served : frame_deadline;
+      if (best < 0 || (late && !best_late) || (late == best_late && key < best_key)) {
+         best = (int) i;
+         best_late = late;
+         best_key = key;
+      }
+   }
+   return best;
+}
+
+void Server::work() {
+   while (true) {
+      std::unique_lock<std::mutex> lock(mutex);
+      int index = -1;
+      work_ready.wait(lock, [&]() { return stopping || (index = next_stream()) >= 0; });
+      if (stopping)
+         return;
+      Stream &stream = *streams[index];
+      // A frame already past its deadline gives way to a newer one
+      Clock::time_point now = Clock::now();
+      while (stream.waiting.size() > 1 &&
+             deadline(stream.options, stream.slots[stream.waiting.front()].submitted) < now) {
+         stream.free_slots.push_back(stream.waiting.front());
+         stream.waiting.pop_front();
+         stream.metrics.dropped++;
+      }
+      int slot = stream.waiting.front();
+      stream.waiting.pop_front();
+      stream.busy = true;
+      stream.last_served = now;
+      n_busy++;
+      lock.unlock();
+
+      Slot &frame = stream.slots[slot];
+      const std::vector<Detections::Detection> &detections = stream.detect(frame.frame);
+      Clock::time_point done = Clock::now();
+      if (callback)
+         callback(index, frame.sequence, detections);
+
+      lock.lock();
+      stream.latest = detections;
+      stream.latest_sequence = frame.sequence;
+      double latency = milliseconds(done - frame.submitted);
+      stream.latencies[stream.n_latencies++ % latency_window] = latency;
+      stream.metrics.processed++;
+      if (done > deadline(stream.options, frame.submitted))
+         stream.metrics.late++;
+      stream.free_slots.push_back(slot);
+      stream.busy = false;
+      n_busy--;
+      lock.unlock();
+      // The stream may have more frames waiting
+      work_ready.notify_one();
+      idle.notify_all();
+   }
+}
+
+bool Server::latest(int stream_index, std::vector<Detections::Detection> &detections, int64_t &sequence) const {
+   std::lock_guard<std::mutex> lock(mutex);
+   if (stream_index < 0 || stream_index >= (int) streams.size() || streams[stream_index]->latest_sequence < 0)
+      return false;
+   detections = streams[stream_index]->latest;
+   sequence = streams[stream_index]->latest_sequence;
+   return true;
+}
+
+void Server::drain() {
+   std::unique_lock<std::mutex> lock(mutex);
+   idle.wait(lock, [this]() {
+      if (n_busy > 0)
+         return false;
+      for (const auto &stream: streams) {
+         if (!stream->waiting.empty() || stream->copying > 0)
+            return false;
+      }
+      return true;
+   });
+}
+
+Metrics Server::metrics(int stream_index) const {
+   std::lock_guard<std::mutex> lock(mutex);
+   if (stream_index < 0 || stream_index >= (int) streams.size())
+      return {};
+   const Stream &stream = *streams[stream_index];
+   return summarize(stream.metrics, stream.first_submitted, window(stream.latencies, stream.n_latencies));
+}
+
+Metrics Server::metrics() const {
+   std::lock_guard<std::mutex> lock(mutex);
+   Metrics sum;
+   Clock::time_point first_submitted = Clock::now();
+   std::vector<double> latencies;
+   for (const auto &stream: streams) {
+      if (stream->metrics.submitted == 0)
+         continue;
+      sum.submitted += stream->metrics.submitted;
+      sum.processed += stream->metrics.processed;
+      sum.dropped += stream->metrics.dropped;
+      sum.late += stream->metrics.late;
+      first_submitted = std::min(first_submitted, stream->first_submitted);
+      std::vector<double> stream_latencies = window(stream->latencies, stream->n_latencies);
+      latencies.insert(latencies.end(), stream_latencies.begin(), stream_latencies.end());
+   }
+   return summarize(sum, first_submitted, latencies);
+}
+
+std::string Server::dump(bool json) const {
+   int n_streams;
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      n_streams = (int) streams.size();
+   }
+   std::ostringstream out;
+   out << std::fixed << std::setprecision(3);
+   auto write = [&](const std::string &name, const Metrics &m) {
+      if (json) {
+         out << "{\"name\": \"" << name << "\", \"submitted\": " << m.submitted << ", \"processed\": "
+             << m.processed << ", \"dropped\": " << m.dropped << ", \"late\": " << m.late << ", \"fps\": " << m.fps
+             << ", \"mean_ms\": " << m.latency_mean << ", \"p50_ms\": " << m.latency_p50 << ", \"p95_ms\": "
+             << m.latency_p95 << ", \"p99_ms\": " << m.latency_p99 << ", \"max_ms\": " << m.latency_max << "}";
+      } else {
+         out << std::left << std::setw(10) << name << std::right << " processed " << std::setw(7) << m.processed
+             << " / " << std::setw(7) << m.submitted << "  dropped " << std::setw(6) << m.dropped << "  late "
+             << std::setw(6) << m.late << "  " << std::setw(8) << m.fps << " fps  mean " << std::setw(9)
+             << m.latency_mean << " ms  p50 " << std::setw(9) << m.latency_p50 << " ms  p95 " << std::setw(9)
+             << m.latency_p95 << " ms  p99 " << std::setw(9) << m.latency_p99 << " ms  max " << std::setw(9)
+             << m.latency_max << " ms\n";
+      }
+   };
+   if (json)
+      out << "{\"all\": ";
+   write("all", metrics());
+   if (json)
+      out << ", \"streams\": [";
+   for (int i = 0; i < n_streams; i++) {
+      if (json && i)
+         out << ", ";
+      write("stream " + std::to_string(i), metrics(i));
+   }
+   if (json)
+      out << "]}";
+   return out.str();
+}
+
+}
@@ -0,0 +1,137 @@
+#ifndef BARCODE_SEGMENTATION_DETECTION_SERVER_H
+#define BARCODE_SEGMENTATION_DETECTION_SERVER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <HalideBuffer.h>
+#include "detections.h"
+#include "partial_drt_registry.h"
+
+// Detection for many camera streams in one process. Every stream has its own detector context and a few preallocated
+// frames. A fixed set of workers takes the waiting frames earliest deadline first, the deadline of a frame being its
+// submission time plus the latency budget of its stream: streams with the same budget are served in turn, and a stream
+// with a tighter budget goes first. Frames already past their deadline are served before the others, the streams
+// taking turns, so an overloaded server degrades every stream alike. A stream is processed by one worker at a time, so
+// its frames complete in order.
+namespace DetectionServer {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Detector {
+   mdd,
+   ps,
+   pdrt2,
+   pdrt32
+};
+
+struct StreamOptions {
+   int width = 1024;
+   int height = 1024;
+   Detector detector = Detector::ps;
+   // Submission to result budget, in milliseconds
+   double deadline_ms = 100;
+   // Frames waiting for a worker. When the stream is full, the oldest waiting frame is dropped for the new one
+   int depth = 2;
+   int min_area = 1;
+   // Threshold normalization of the partial strided DRT detectors, see PartialDRT::Context::set_normalization. A
+   // moving average suits a camera stream. Ignored by the MDD
+   PartialDRT::Normalization normalization = PartialDRT::Normalization::per_frame;
+   float normalization_value = 0;
+};
+
+struct Metrics {
+   int64_t submitted = 0;
+   int64_t processed = 0;
+   // Frames replaced by newer ones, because the stream was full or because their deadline passed while a newer frame
+   // was waiting
+   int64_t dropped = 0;
+   // Processed frames whose result came after their deadline
+   int64_t late = 0;
+   // Processed frames per second since the first submission
+   double fps = 0;
+   // Submission to result of the last processed frames, in milliseconds
+   double latency_mean = 0, latency_p50 = 0, latency_p95 = 0, latency_p99 = 0, latency_max = 0;
+};
+
+// Called by the worker that processed the frame. The detections are only valid during the call
+using Callback = std::function<void(int stream, int64_t sequence, const std::vector<Detections::Detection> &)>;
+
+class Server {
+public:
+   // 0 workers for one per hardware thread. Each Halide call also spreads over the Halide or ThreadPool threads
+   explicit Server(int n_workers = 0, Callback callback = nullptr);
+   // Waiting frames are discarded
+   ~Server();
+
+   // Returns the index of the new stream, or -1 when an option is out of range
+   int add_stream(const StreamOptions &options);
+
+   // Copies a width x height frame of the stream and returns its sequence number, counted from 0 per stream, or -1
+   // for an unknown stream or a frame of another size. Any thread may submit to any stream
+   int64_t submit(int stream, const Halide::Runtime::Buffer<uint8_t> &frame);
+
+   // Detections of the newest processed frame of the stream, and its sequence number. False when none is processed
+   bool latest(int stream, std::vector<Detections::Detection> &detections, int64_t &sequence) const;
+
+   // Waits until every submitted frame is processed or dropped, including those still being copied in by submit()
+   void drain();
+
+   Metrics metrics(int stream) const;
+   // Sums over every stream, the latencies being those of all the streams
+   Metrics metrics() const;
+   // Aggregate and per-stream metrics, as text or JSON
+   std::string dump(bool json) const;
+
+private:
+   struct Slot {
+      Halide::Runtime::Buffer<uint8_t> frame;
+      Clock::time_point submitted;
+      int64_t sequence;
+   };
+
+   struct Stream {
+      StreamOptions options;
+      std::function<const std::vector<Detections::Detection> &(Halide::Runtime::Buffer<uint8_t> &)> detect;
+      std::vector<Slot> slots;
+      // Waiting slots, oldest first, and free ones
+      std::deque<int> waiting;
+      std::vector<int> free_slots;
+      // Slots being copied into by submit()
+      int copying = 0;
+      bool busy = false;
+      Clock::time_point last_served;
+      int64_t next_sequence = 0;
+      std::vector<Detections::Detection> latest;
+      int64_t latest_sequence = -1;
+      Metrics metrics;
+      Clock::time_point first_submitted;
+      // Ring of the last latencies
+      std::vector<double> latencies;
+      size_t n_latencies = 0;
+   };
+
+   void work();
+   // Idle stream to process next, -1 when none
+   int next_stream() const;
+
+   std::vector<std::unique_ptr<Stream>> streams;
+   std::vector<std::thread> workers;
+   Callback callback;
+   mutable std::mutex mutex;
+   std::condition_variable work_ready;
+   std::condition_variable idle;
+   int n_busy = 0;
+   bool stopping = false;
+};
+
+}
+
+#endif //BARCODE_SEGMENTATION_DETECTION_SERVER_H
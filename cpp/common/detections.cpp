@@ -0,0 +1,122 @@
+#include "detections.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Detections {
+
+Planes allocate_planes(int n_squares_x, int n_squares_y, int frames) {
+   Planes planes;
+   planes.angles = Halide::Runtime::Buffer<uint8_t>(n_squares_x, n_squares_y, frames);
+   planes.scores = Halide::Runtime::Buffer<uint8_t>(n_squares_x, n_squares_y, frames);
+   planes.mask = Halide::Runtime::Buffer<uint8_t>((n_squares_x + 7) / 8, n_squares_y, frames);
+   return planes;
+}
+
+const std::vector<Detection> &Extractor::extract(const Planes &planes, int frame, int stride, int tile_size,
+                                                 int min_area) {
+   int n_squares_x = planes.angles.dim(0).extent();
+   int n_squares_y = planes.angles.dim(1).extent();
+   auto masked = [&](int x, int y) {
+      return (planes.mask(x / 8, y, frame) >> (x % 8)) & 1;
+   };
+   labels.assign((size_t) n_squares_x * n_squares_y, -1);
+   detections.clear();
+   for (int y0 = 0; y0 < n_squares_y; y0++) {
+      for (int x0 = 0; x0 < n_squares_x; x0++) {
+         if (!masked(x0, y0) || labels[y0 * n_squares_x + x0] >= 0)
+            continue;
+         // Flood fill, members ends up holding the squares of the region
+         int label = (int) detections.size();
+         members.clear();
+         members.push_back(y0 * n_squares_x + x0);
+         labels[y0 * n_squares_x + x0] = label;
+         for (size_t i = 0; i < members.size(); i++) {
+            int x = members[i] % n_squares_x;
+            int y = members[i] / n_squares_x;
+            for (int ny = std::max(0, y - 1); ny <= std::min(n_squares_y - 1, y + 1); ny++) {
+               for (int nx = std::max(0, x - 1); nx <= std::min(n_squares_x - 1, x + 1); nx++) {
+                  if (masked(nx, ny) && labels[ny * n_squares_x + nx] < 0) {
+                     labels[ny * n_squares_x + nx] = label;
+                     members.push_back(ny * n_squares_x + nx);
+                  }
+               }
+            }
+         }
+         if ((int) members.size() < min_area) {
+            // Still labeled so it is not filled again, but not reported
+            detections.push_back({});
+            detections.back().area = -1;
+            continue;
+         }
+
+         // Moments of the square centers, and score weighted mean of the doubled bar angles
+         double sum_x = 0, sum_y = 0, sum_xx = 0, sum_yy = 0, sum_xy = 0;
+         double sum_score = 0, sum_cos = 0, sum_sin = 0;
+         int x_min = n_squares_x, y_min = n_squares_y, x_max = 0, y_max = 0;
+         for (int32_t member: members) {
+            int x = member % n_squares_x;
+            int y = member / n_squares_x;
+            double cx = x * stride + tile_size / 2.0;
+            double cy = y * stride + tile_size / 2.0;
+            sum_x += cx;
+            sum_y += cy;
+            sum_xx += cx * cx;
+            sum_yy += cy * cy;
+            sum_xy += cx * cy;
+            double score = (double) planes.scores(x, y, frame) / score_scale;
+            double angle = planes.angles(x, y, frame) * M_PI / 256.0;
+            sum_score += score;
+            sum_cos += score * std::cos(2 * angle);
+            sum_sin += score * std::sin(2 * angle);
+            x_min = std::min(x_min, x);
+            y_min = std::min(y_min, y);
+            x_max = std::max(x_max, x);
+            y_max = std::max(y_max, y);
+         }
+         double n = (double) members.size();
+         double mean_x = sum_x / n;
+         double mean_y = sum_y / n;
+         double mu_xx = sum_xx / n - mean_x * mean_x;
+         double mu_yy = sum_yy / n - mean_y * mean_y;
+         double mu_xy = sum_xy / n - mean_x * mean_y;
+         double orientation = 0.5 * std::atan2(2 * mu_xy, mu_xx - mu_yy);
+         double ux = std::cos(orientation), uy = std::sin(orientation);
+         double u_min = 0, u_max = 0, v_min = 0, v_max = 0;
+         for (int32_t member: members) {
+            double dx = (member % n_squares_x) * stride + tile_size / 2.0 - mean_x;
+            double dy = (member / n_squares_x) * stride + tile_size / 2.0 - mean_y;
+            double u = dx * ux + dy * uy;
+            double v = -dx * uy + dy * ux;
+            u_min = std::min(u_min, u);
+            u_max = std::max(u_max, u);
+            v_min = std::min(v_min, v);
+            v_max = std::max(v_max, v);
+         }
+         double angle = 0.5 * std::atan2(sum_sin, sum_cos);
+
+         Detection detection;
+         // Each square stands for the stride x stride pixels around its center
+         int offset = tile_size / 2 - stride / 2;
+         detection.x_min = x_min * stride + offset;
+         detection.y_min = y_min * stride + offset;
+         detection.x_max = (x_max + 1) * stride + offset;
+         detection.y_max = (y_max + 1) * stride + offset;
+         detection.center_x = (float) (mean_x + ux * (u_min + u_max) / 2 - uy * (v_min + v_max) / 2);
+         detection.center_y = (float) (mean_y + uy * (u_min + u_max) / 2 + ux * (v_min + v_max) / 2);
+         detection.length = (float) (u_max - u_min + stride);
+         detection.width = (float) (v_max - v_min + stride);
+         detection.orientation = (float) orientation;
+         detection.angle = (float) (angle < 0 ? angle + M_PI : angle);
+         detection.score = (float) (sum_score / n);
+         detection.area = (int) members.size();
+         detections.push_back(detection);
+      }
+   }
+   detections.erase(std::remove_if(detections.begin(), detections.end(),
+                                   [](const Detection &detection) { return detection.area < 0; }),
+                    detections.end());
+   return detections;
+}
+
+}
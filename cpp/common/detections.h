@@ -0,0 +1,54 @@
+#ifndef BARCODE_SEGMENTATION_DETECTIONS_H
+#define BARCODE_SEGMENTATION_DETECTIONS_H
+
+#include <vector>
+#include <HalideBuffer.h>
+
+namespace Detections {
+
+// Score planes store the score relative to the detection threshold, scaled by this factor and saturated to 255
+const int score_scale = 64;
+
+// One connected region of the thresholded output, in input image pixels
+struct Detection {
+   // Axis aligned bounding box, x_max and y_max excluded
+   int x_min, y_min, x_max, y_max;
+   // Oriented box given by the second order moments of the region, orientation of its long side in radians
+   float center_x, center_y;
+   float length, width;
+   float orientation;
+   // Mean bar angle, the range of slope indices mapped onto [0, pi) radians
+   float angle;
+   // Mean score, 1 being the detection threshold
+   float score;
+   // Number of squares in the region
+   int area;
+};
+
+// Angle, score and mask planes written by the threshold_planes and argmaxth_planes pipelines, one value per square
+// and a frame dimension. The mask holds one bit per square, 8 squares along x per byte, least significant bit first
+struct Planes {
+   Halide::Runtime::Buffer<uint8_t> angles;
+   Halide::Runtime::Buffer<uint8_t> scores;
+   Halide::Runtime::Buffer<uint8_t> mask;
+};
+
+Planes allocate_planes(int n_squares_x, int n_squares_y, int frames);
+
+// Labels the 8-connected regions of the mask of one frame and describes them. Squares are laid every `stride` pixels,
+// the first one being centered at tile_size / 2. Regions smaller than min_area squares are dropped. Keeps its working
+// set between calls, one extractor per thread
+class Extractor {
+public:
+   const std::vector<Detection> &extract(const Planes &planes, int frame, int stride, int tile_size,
+                                         int min_area = 1);
+
+private:
+   std::vector<int32_t> labels;
+   std::vector<int32_t> members;
+   std::vector<Detection> detections;
+};
+
+}
+
+#endif //BARCODE_SEGMENTATION_DETECTIONS_H
@@ -0,0 +1,85 @@
+#include "dirty_tiles.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace DirtyTiles {
+
+bool Tracker::update(const Halide::Runtime::Buffer<uint8_t> &frame, int threshold) {
+   int width = frame.width(), height = frame.height();
+   bool comparable = previous.data() && previous.width() == width && previous.height() == height;
+   n_tiles_x = (width + tile_size - 1) / tile_size;
+   n_tiles_y = (height + tile_size - 1) / tile_size;
+   dirty_tiles.assign((size_t) n_tiles_x * n_tiles_y, comparable ? 0 : 1);
+   if (!comparable) {
+      previous = Halide::Runtime::Buffer<uint8_t>(width, height);
+   } else {
+      for (int tile_y = 0; tile_y < n_tiles_y; tile_y++) {
+         for (int tile_x = 0; tile_x < n_tiles_x; tile_x++) {
+            int x_end = std::min(width, (tile_x + 1) * tile_size);
+            int y_end = std::min(height, (tile_y + 1) * tile_size);
+            int sad = 0;
+            for (int y = tile_y * tile_size; y < y_end; y++)
+               for (int x = tile_x * tile_size; x < x_end; x++)
+                  sad += std::abs(frame(x, y) - previous(x, y));
+            int n_pixels = (x_end - tile_x * tile_size) * (y_end - tile_y * tile_size);
+            dirty_tiles[tile_y * n_tiles_x + tile_x] = sad > threshold * n_pixels;
+         }
+      }
+   }
+   previous.copy_from(frame);
+   return comparable;
+}
+
+void Tracker::mark(const std::vector<ROI::Rect> &rects, int width, int height) {
+   n_tiles_x = (width + tile_size - 1) / tile_size;
+   n_tiles_y = (height + tile_size - 1) / tile_size;
+   dirty_tiles.assign((size_t) n_tiles_x * n_tiles_y, 0);
+   for (const ROI::Rect &rect: rects) {
+      ROI::Range tiles_x = ROI::squares(rect.x, rect.x + rect.width, tile_size, tile_size, n_tiles_x);
+      ROI::Range tiles_y = ROI::squares(rect.y, rect.y + rect.height, tile_size, tile_size, n_tiles_y);
+      for (int tile_y = tiles_y.begin; tile_y < tiles_y.end; tile_y++)
+         for (int tile_x = tiles_x.begin; tile_x < tiles_x.end; tile_x++)
+            dirty_tiles[tile_y * n_tiles_x + tile_x] = 1;
+   }
+}
+
+bool Tracker::dirty(int tile_x, int tile_y) const {
+   return dirty_tiles[tile_y * n_tiles_x + tile_x];
+}
+
+int Tracker::n_dirty() const {
+   return (int) std::count(dirty_tiles.begin(), dirty_tiles.end(), 1);
+}
+
+std::vector<Span> Tracker::row_spans() const {
+   std::vector<Span> spans;
+   for (int tile_y = 0; tile_y < n_tiles_y; tile_y++) {
+      for (int tile_x = 0; tile_x < n_tiles_x; tile_x++) {
+         if (!dirty(tile_x, tile_y))
+            continue;
+         if (!spans.empty() && spans.back().band == tile_y && spans.back().end == tile_x)
+            spans.back().end++;
+         else
+            spans.push_back({tile_y, tile_x, tile_x + 1});
+      }
+   }
+   return spans;
+}
+
+std::vector<Span> Tracker::column_spans() const {
+   std::vector<Span> spans;
+   for (int tile_x = 0; tile_x < n_tiles_x; tile_x++) {
+      for (int tile_y = 0; tile_y < n_tiles_y; tile_y++) {
+         if (!dirty(tile_x, tile_y))
+            continue;
+         if (!spans.empty() && spans.back().band == tile_x && spans.back().end == tile_y)
+            spans.back().end++;
+         else
+            spans.push_back({tile_x, tile_y, tile_y + 1});
+      }
+   }
+   return spans;
+}
+
+}
@@ -0,0 +1,46 @@
+#ifndef BARCODE_SEGMENTATION_DIRTY_TILES_H
+#define BARCODE_SEGMENTATION_DIRTY_TILES_H
+
+#include <vector>
+#include <HalideBuffer.h>
+#include "roi.h"
+
+namespace DirtyTiles {
+
+// Side of the tiles the frames are compared on, in pixels
+const int tile_size = 32;
+
+// Run of consecutive dirty tiles on one row (or column) of tiles, in tiles, end excluded
+struct Span {
+   int band;
+   int begin;
+   int end;
+};
+
+// Finds the tiles of a frame that changed since the previous one, by their mean absolute difference
+class Tracker {
+public:
+   // Compares the frame with the previous one and keeps a copy of it. Returns false when there is no previous frame
+   // of the same size, every tile is then dirty
+   bool update(const Halide::Runtime::Buffer<uint8_t> &frame, int threshold);
+   // Marks the tiles of a width x height image that overlap the rects as dirty, and the others as clean. The previous
+   // frame is left as is
+   void mark(const std::vector<ROI::Rect> &rects, int width, int height);
+
+   int n_dirty() const;
+   // Dirty spans of each row of tiles, and of each column of tiles
+   std::vector<Span> row_spans() const;
+   std::vector<Span> column_spans() const;
+
+private:
+   bool dirty(int tile_x, int tile_y) const;
+
+   Halide::Runtime::Buffer<uint8_t> previous;
+   std::vector<uint8_t> dirty_tiles;
+   int n_tiles_x = 0;
+   int n_tiles_y = 0;
+};
+
+}
+
+#endif //BARCODE_SEGMENTATION_DIRTY_TILES_H
@@ -0,0 +1,18 @@
+#include "drt_geometry.h"
+#include <algorithm>
+
+int DRTGeometry::n_squares(int n, int tile_size, int stride, int stage) {
+   int stage_size = 1 << stage;
+   return (n - std::min(stage_size, tile_size)) / std::min(stage_size, stride) + 1;
+}
+
+int DRTGeometry::n_slopes(int stage) {
+   return 2 * (1 << stage) - 1;
+}
+
+int DRTGeometry::last_stage(int tile_size) {
+   int stage = 0;
+   while ((1 << stage) < tile_size)
+      stage++;
+   return stage;
+}
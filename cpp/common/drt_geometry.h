@@ -0,0 +1,17 @@
+#ifndef BARCODE_SEGMENTATION_DRT_GEOMETRY_H
+#define BARCODE_SEGMENTATION_DRT_GEOMETRY_H
+
+namespace DRTGeometry {
+
+// Number of squares laid by stage `stage` of a partial strided DRT along an image side of `n` pixels
+int n_squares(int n, int tile_size, int stride, int stage);
+
+// Number of slopes computed by stage `stage` of the DRT
+int n_slopes(int stage);
+
+// Last stage of a partial strided DRT, where the squares reach `tile_size` lines
+int last_stage(int tile_size);
+
+}
+
+#endif //BARCODE_SEGMENTATION_DRT_GEOMETRY_H
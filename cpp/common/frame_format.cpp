@@ -0,0 +1,26 @@
+#include "frame_format.h"
+
+namespace FrameFormat {
+
+Halide::Runtime::Buffer<uint8_t> strided_luma(uint8_t *data, int width, int height, int row_stride, int step) {
+   halide_dimension_t shape[2] = {{0, width, step}, {0, height, row_stride}};
+   return Halide::Runtime::Buffer<uint8_t>(data, 2, shape);
+}
+
+Halide::Runtime::Buffer<uint8_t> luma(uint8_t *data, int width, int height, int row_stride, int format) {
+   switch (format) {
+      case y8:
+      case nv12:
+         return strided_luma(data, width, height, row_stride);
+      case yuyv:
+         return strided_luma(data, width, height, row_stride, 2);
+      case uyvy:
+         return strided_luma(data + 1, width, height, row_stride, 2);
+      case bgr24:
+         return strided_luma(data, width, height, row_stride, 3);
+      default:
+         return {};
+   }
+}
+
+}
@@ -0,0 +1,32 @@
+#ifndef BARCODE_SEGMENTATION_FRAME_FORMAT_H
+#define BARCODE_SEGMENTATION_FRAME_FORMAT_H
+
+#include <HalideBuffer.h>
+
+// Luma of camera frames, viewed in place: the DRT stages read it through the strides of the view, so a frame is
+// never copied into a dense image
+namespace FrameFormat {
+
+enum PixelFormat {
+   // 8-bit gray
+   y8 = 0,
+   // Luma plane of semi-planar 4:2:0 (NV12, NV21), followed by the chroma plane
+   nv12 = 1,
+   // Packed 4:2:2, the luma samples are every other byte, starting with the first (YUYV) or the second (UYVY)
+   yuyv = 2,
+   uyvy = 3,
+   // First channel of packed 24-bit color, as OpenCV captures it
+   bgr24 = 4
+};
+
+// Width x height view of luma samples `step` bytes apart, on rows row_stride bytes apart. The frame stays owned by
+// the caller and must outlive the view
+Halide::Runtime::Buffer<uint8_t> strided_luma(uint8_t *data, int width, int height, int row_stride, int step = 1);
+
+// Luma of a frame of the given format, row_stride being the pitch of its rows (of the luma plane for NV12). An empty
+// buffer for unknown formats
+Halide::Runtime::Buffer<uint8_t> luma(uint8_t *data, int width, int height, int row_stride, int format);
+
+}
+
+#endif //BARCODE_SEGMENTATION_FRAME_FORMAT_H
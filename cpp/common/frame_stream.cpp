@@ -0,0 +1,163 @@
+#include "frame_stream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+namespace FrameStream {
+
+FrameQueue::FrameQueue(int width, int height, int depth) : depth(depth) {
+   if (width <= 0 || height <= 0 || depth < 1)
+      throw std::invalid_argument("FrameQueue needs a positive frame size and a depth of at least 1");
+   // The waiting frames, the one being written and the one being processed
+   int n_slots = depth + 2;
+   for (int i = 0; i < n_slots; i++) {
+      slots.push_back({Halide::Runtime::Buffer<uint8_t>(width, height), Clock::time_point()});
+      free_slots.push_back(i);
+   }
+   waiting.reserve(n_slots);
+}
+
+Halide::Runtime::Buffer<uint8_t> &FrameQueue::begin_write() {
+   std::lock_guard<std::mutex> lock(mutex);
+   // At most `depth` frames wait and one is processed, so a slot is always free
+   writing = free_slots.back();
+   free_slots.pop_back();
+   return slots[writing].frame;
+}
+
+void FrameQueue::end_write(Clock::time_point captured) {
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      slots[writing].captured = captured;
+      if ((int) waiting.size() >= depth) {
+         // Latest frame wins
+         free_slots.push_back(waiting.front());
+         waiting.erase(waiting.begin());
+         n_dropped++;
+      }
+      waiting.push_back(writing);
+      writing = -1;
+   }
+   ready.notify_one();
+}
+
+bool FrameQueue::begin_read(Halide::Runtime::Buffer<uint8_t> *&frame, Clock::time_point &captured) {
+   std::unique_lock<std::mutex> lock(mutex);
+   ready.wait(lock, [this]() { return closed || !waiting.empty(); });
+   if (waiting.empty())
+      return false;
+   reading = waiting.front();
+   waiting.erase(waiting.begin());
+   frame = &slots[reading].frame;
+   captured = slots[reading].captured;
+   return true;
+}
+
+void FrameQueue::end_read() {
+   std::lock_guard<std::mutex> lock(mutex);
+   free_slots.push_back(reading);
+   reading = -1;
+}
+
+void FrameQueue::close() {
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+   }
+   ready.notify_one();
+}
+
+int FrameQueue::dropped() const {
+   std::lock_guard<std::mutex> lock(mutex);
+   return n_dropped;
+}
+
+RawFileSource::RawFileSource(const std::string &path, bool loop) : file(fopen(path.c_str(), "rb")), loop(loop) {
+   if (!file)
+      throw std::runtime_error("Cannot open " + path);
+}
+
+RawFileSource::~RawFileSource() {
+   fclose(file);
+}
+
+bool RawFileSource::read(Halide::Runtime::Buffer<uint8_t> &frame) {
+   size_t size = (size_t) frame.width() * frame.height();
+   if (fread(frame.data(), 1, size, file) == size)
+      return true;
+   if (!loop)
+      return false;
+   rewind(file);
+   return fread(frame.data(), 1, size, file) == size;
+}
+
+bool SyntheticSource::read(Halide::Runtime::Buffer<uint8_t> &frame) {
+   // A patch of bars crossing the frame horizontally
+   double angle = frame_index * 0.01;
+   double c = std::cos(angle), s = std::sin(angle);
+   int center_x = (frame_index * 3) % frame.width();
+   int center_y = frame.height() / 2;
+   uint32_t noise = 2166136261u + frame_index;
+   for (int y = 0; y < frame.height(); y++) {
+      for (int x = 0; x < frame.width(); x++) {
+         noise = noise * 1664525u + 1013904223u;
+         double u = (x - center_x) * c + (y - center_y) * s;
+         bool inside = std::abs(x - center_x) < frame.width() / 4 && std::abs(y - center_y) < frame.height() / 6;
+         bool bar = inside && ((int) std::floor(u / 6) % 2 == 0);
+         frame(x, y) = (uint8_t) ((bar ? 30 : 200) + (noise >> 28));
+      }
+   }
+   frame_index++;
+   return true;
+}
+
+Statistics run(FrameSource &source, int width, int height, int depth, double capture_fps, int n_frames,
+               const std::function<void(Halide::Runtime::Buffer<uint8_t> &)> &process) {
+   FrameQueue queue(width, height, depth);
+   Statistics statistics;
+   std::vector<double> latencies;
+   latencies.reserve(n_frames);
+
+   Clock::time_point start = Clock::now();
+   std::thread producer([&]() {
+      auto period = std::chrono::duration<double>(capture_fps > 0 ? 1.0 / capture_fps : 0.0);
+      for (int i = 0; i < n_frames; i++) {
+         Halide::Runtime::Buffer<uint8_t> &frame = queue.begin_write();
+         if (!source.read(frame))
+            break;
+         queue.end_write(Clock::now());
+         statistics.captured++;
+         std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(period * (i + 1)));
+      }
+      queue.close();
+   });
+   std::thread consumer([&]() {
+      Halide::Runtime::Buffer<uint8_t> *frame;
+      Clock::time_point captured;
+      while (queue.begin_read(frame, captured)) {
+         process(*frame);
+         latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - captured).count());
+         queue.end_read();
+      }
+   });
+   producer.join();
+   consumer.join();
+   double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+   statistics.processed = (int) latencies.size();
+   statistics.dropped = queue.dropped();
+   statistics.fps = statistics.processed / elapsed;
+   if (!latencies.empty()) {
+      for (double latency: latencies)
+         statistics.latency_mean += latency / latencies.size();
+      std::sort(latencies.begin(), latencies.end());
+      statistics.latency_p50 = latencies[latencies.size() / 2];
+      statistics.latency_p95 = latencies[std::min(latencies.size() - 1, latencies.size() * 95 / 100)];
+      statistics.latency_max = latencies.back();
+   }
+   return statistics;
+}
+
+}
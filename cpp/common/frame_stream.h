@@ -0,0 +1,104 @@
+#ifndef BARCODE_SEGMENTATION_FRAME_STREAM_H
+#define BARCODE_SEGMENTATION_FRAME_STREAM_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <HalideBuffer.h>
+
+namespace FrameStream {
+
+using Clock = std::chrono::steady_clock;
+
+// Bounded queue of preallocated frames between one producer and one consumer. Holds up to `depth` frames waiting to
+// be processed, plus the one being written and the one being processed. When the queue is full, the oldest waiting
+// frame is dropped in favour of the new one, so the consumer always works on recent frames.
+class FrameQueue {
+public:
+   // Throws std::invalid_argument unless the size is positive and the depth at least 1
+   FrameQueue(int width, int height, int depth);
+
+   // Frame the producer writes the next image into. Never blocks
+   Halide::Runtime::Buffer<uint8_t> &begin_write();
+   // Queues the frame returned by begin_write(), dropping the oldest waiting one if the queue is full
+   void end_write(Clock::time_point captured);
+
+   // Waits for the oldest waiting frame, returns false once the queue is closed and empty
+   bool begin_read(Halide::Runtime::Buffer<uint8_t> *&frame, Clock::time_point &captured);
+   // Releases the frame returned by begin_read()
+   void end_read();
+
+   // Wakes up the consumer once the waiting frames are processed
+   void close();
+
+   int dropped() const;
+
+private:
+   struct Slot {
+      Halide::Runtime::Buffer<uint8_t> frame;
+      Clock::time_point captured;
+   };
+
+   std::vector<Slot> slots;
+   int depth;
+   // Indices of the waiting slots, oldest first, and of the free ones
+   std::vector<int> waiting;
+   std::vector<int> free_slots;
+   int writing = -1;
+   int reading = -1;
+   int n_dropped = 0;
+   bool closed = false;
+   mutable std::mutex mutex;
+   std::condition_variable ready;
+};
+
+// Producer side of a stream, fills a frame and returns false when there are no more frames
+class FrameSource {
+public:
+   virtual ~FrameSource() = default;
+   virtual bool read(Halide::Runtime::Buffer<uint8_t> &frame) = 0;
+};
+
+// 8-bit grayscale frames stored one after the other in a file, without header
+class RawFileSource : public FrameSource {
+public:
+   RawFileSource(const std::string &path, bool loop);
+   ~RawFileSource() override;
+   bool read(Halide::Runtime::Buffer<uint8_t> &frame) override;
+
+private:
+   FILE *file;
+   bool loop;
+};
+
+// Moving bars over a noisy background, the orientation of the bars turning slowly
+class SyntheticSource : public FrameSource {
+public:
+   bool read(Halide::Runtime::Buffer<uint8_t> &frame) override;
+
+private:
+   int frame_index = 0;
+};
+
+struct Statistics {
+   int captured = 0;
+   int processed = 0;
+   int dropped = 0;
+   double fps = 0;
+   // Capture to end of processing, in milliseconds
+   double latency_mean = 0, latency_p50 = 0, latency_p95 = 0, latency_max = 0;
+};
+
+// Runs a producer thread reading `source` at `capture_fps` (as fast as possible if 0) and a consumer thread calling
+// `process` on each frame it gets from a queue of the given depth. Stops after `n_frames` captured frames or at the end
+// of the source
+Statistics run(FrameSource &source, int width, int height, int depth, double capture_fps, int n_frames,
+               const std::function<void(Halide::Runtime::Buffer<uint8_t> &)> &process);
+
+}
+
+#endif //BARCODE_SEGMENTATION_FRAME_STREAM_H
@@ -0,0 +1,180 @@
+#include "instrumentation.h"
+
+#ifdef WITH_INSTRUMENTATION
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#endif
+
+namespace Instrumentation {
+
+#ifdef WITH_INSTRUMENTATION
+
+namespace {
+
+const char *stage_names[] = {
+#define INSTRUMENTATION_NAME(name) #name,
+   INSTRUMENTATION_STAGES(INSTRUMENTATION_NAME)
+#undef INSTRUMENTATION_NAME
+};
+
+const int n_stages = (int) Stage::count;
+// Bucket b counts the durations in [2^b, 2^(b + 1)) nanoseconds, up to about 9 minutes
+const int n_buckets = 40;
+
+// Histograms written by one thread only, so the counters are plain relaxed loads and stores. Readers may see a
+// slightly stale but never torn value
+struct Histograms {
+   std::atomic<uint64_t> buckets[n_stages][n_buckets];
+   std::atomic<uint64_t> count[n_stages];
+   std::atomic<uint64_t> total[n_stages];
+   std::atomic<uint64_t> max[n_stages];
+
+   Histograms() {
+      for (int s = 0; s < n_stages; s++) {
+         for (int b = 0; b < n_buckets; b++)
+            buckets[s][b].store(0, std::memory_order_relaxed);
+         count[s].store(0, std::memory_order_relaxed);
+         total[s].store(0, std::memory_order_relaxed);
+         max[s].store(0, std::memory_order_relaxed);
+      }
+   }
+};
+
+void add(std::atomic<uint64_t> &counter, uint64_t value) {
+   counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Histograms of every thread that ever recorded a stage. They are never freed, so a dump can still read the ones of
+// finished threads. The mutex is only taken by a thread's first record and by dump() and reset()
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<Histograms>> &registry() {
+   static std::vector<std::unique_ptr<Histograms>> histograms;
+   return histograms;
+}
+
+Histograms &thread_histograms() {
+   thread_local Histograms *histograms = nullptr;
+   if (!histograms) {
+      std::lock_guard<std::mutex> lock(registry_mutex);
+      registry().push_back(std::make_unique<Histograms>());
+      histograms = registry().back().get();
+   }
+   return *histograms;
+}
+
+long long now() {
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Summary {
+   uint64_t count = 0, total = 0, max = 0;
+   uint64_t buckets[n_buckets] = {};
+
+   // Upper bound of the bucket holding the given fraction of the samples, in nanoseconds
+   uint64_t percentile(double p) const {
+      uint64_t rank = (uint64_t) (p * count + 0.5), seen = 0;
+      for (int b = 0; b < n_buckets; b++) {
+         seen += buckets[b];
+         if (seen >= std::max<uint64_t>(rank, 1))
+            return std::min<uint64_t>(2ull << b, max);
+      }
+      return max;
+   }
+};
+
+}
+
+void record(Stage stage, long long nanoseconds) {
+   Histograms &histograms = thread_histograms();
+   int s = (int) stage;
+   uint64_t duration = (uint64_t) std::max(nanoseconds, 1ll);
+   int bucket = std::min(63 - __builtin_clzll(duration), n_buckets - 1);
+   add(histograms.buckets[s][bucket], 1);
+   add(histograms.count[s], 1);
+   add(histograms.total[s], duration);
+   if (duration > histograms.max[s].load(std::memory_order_relaxed))
+      histograms.max[s].store(duration, std::memory_order_relaxed);
+}
+
+Timer::Timer(Stage stage) : stage(stage), start(now()) {}
+
+Timer::~Timer() {
+   record(stage, now() - start);
+}
+
+std::string dump(bool json) {
+   Summary summaries[n_stages];
+   {
+      std::lock_guard<std::mutex> lock(registry_mutex);
+      for (const auto &histograms: registry()) {
+         for (int s = 0; s < n_stages; s++) {
+            Summary &summary = summaries[s];
+            summary.count += histograms->count[s].load(std::memory_order_relaxed);
+            summary.total += histograms->total[s].load(std::memory_order_relaxed);
+            summary.max = std::max(summary.max, (uint64_t) histograms->max[s].load(std::memory_order_relaxed));
+            for (int b = 0; b < n_buckets; b++)
+               summary.buckets[b] += histograms->buckets[s][b].load(std::memory_order_relaxed);
+         }
+      }
+   }
+   std::ostringstream out;
+   out << std::fixed << std::setprecision(3);
+   if (json)
+      out << "{\"stages\": [";
+   bool first = true;
+   for (int s = 0; s < n_stages; s++) {
+      const Summary &summary = summaries[s];
+      if (!summary.count)
+         continue;
+      double mean = summary.total * 1e-6 / summary.count;
+      double p50 = summary.percentile(0.5) * 1e-6, p95 = summary.percentile(0.95) * 1e-6;
+      double p99 = summary.percentile(0.99) * 1e-6, max = summary.max * 1e-6;
+      if (json) {
+         out << (first ? "" : ", ") << "{\"name\": \"" << stage_names[s] << "\", \"count\": " << summary.count
+             << ", \"mean_ms\": " << mean << ", \"p50_ms\": " << p50 << ", \"p95_ms\": " << p95
+             << ", \"p99_ms\": " << p99 << ", \"max_ms\": " << max << "}";
+      } else {
+         out << std::left << std::setw(32) << stage_names[s] << std::right << " count " << std::setw(8)
+             << summary.count << "  mean " << std::setw(9) << mean << " ms  p50 <" << std::setw(9) << p50
+             << " ms  p95 <" << std::setw(9) << p95 << " ms  p99 <" << std::setw(9) << p99 << " ms  max "
+             << std::setw(9) << max << " ms\n";
+      }
+      first = false;
+   }
+   if (json)
+      out << "]}";
+   return out.str();
+}
+
+void reset() {
+   std::lock_guard<std::mutex> lock(registry_mutex);
+   for (const auto &histograms: registry()) {
+      for (int s = 0; s < n_stages; s++) {
+         for (int b = 0; b < n_buckets; b++)
+            histograms->buckets[s][b].store(0, std::memory_order_relaxed);
+         histograms->count[s].store(0, std::memory_order_relaxed);
+         histograms->total[s].store(0, std::memory_order_relaxed);
+         histograms->max[s].store(0, std::memory_order_relaxed);
+      }
+   }
+}
+
+#else
+
+std::string dump(bool json) {
+   return json ? "{\"disabled\": true}" : "instrumentation disabled\n";
+}
+
+void reset() {}
+
+#endif
+
+}
@@ -0,0 +1,97 @@
+#ifndef BARCODE_SEGMENTATION_INSTRUMENTATION_H
+#define BARCODE_SEGMENTATION_INSTRUMENTATION_H
+
+#include <string>
+
+// Per-stage latency histograms of the detectors, built with -DWITH_INSTRUMENTATION
+// (-DBARCODE_SEGMENTATION_INSTRUMENTATION=ON in CMake). Without it INSTRUMENTED(stage, call) is just the call, and
+// dump() reports that instrumentation is disabled.
+namespace Instrumentation {
+
+// One stage per pipeline library the detectors call, named after it
+#define INSTRUMENTATION_STAGES(X) \
+   X(mdd_drt_v) X(mdd_drt_h) \
+   X(mdd_bar_detector_0) X(mdd_bar_detector_1) X(mdd_bar_detector_2) X(mdd_bar_detector_3) X(mdd_bar_detector_4) \
+   X(unpool_3) X(convolutions_3) X(unpool_2) X(convolutions_2) X(unpool_1) X(convolutions_1) X(unpool_0) \
+   X(convolutions_0) \
+   X(unpool_convolutions_3) X(unpool_convolutions_2) X(unpool_convolutions_1) X(unpool_convolutions_0) \
+   X(argmaxth) X(argmaxth_planes) \
+   X(mdd_drt_v_region) X(mdd_drt_h_region) \
+   X(mdd_bar_detector_0_region) X(mdd_bar_detector_1_region) X(mdd_bar_detector_2_region) \
+   X(mdd_bar_detector_3_region) X(mdd_bar_detector_4_region) \
+   X(mdd_drt_v_batch) X(mdd_drt_h_batch) \
+   X(mdd_bar_detector_0_batch) X(mdd_bar_detector_1_batch) X(mdd_bar_detector_2_batch) \
+   X(mdd_bar_detector_3_batch) X(mdd_bar_detector_4_batch) \
+   X(unpool_3_batch) X(convolutions_3_batch) X(unpool_2_batch) X(convolutions_2_batch) X(unpool_1_batch) \
+   X(convolutions_1_batch) X(unpool_0_batch) X(convolutions_0_batch) \
+   X(unpool_convolutions_3_batch) X(unpool_convolutions_2_batch) X(unpool_convolutions_1_batch) \
+   X(unpool_convolutions_0_batch) \
+   X(argmaxth_batch) \
+   X(mdd_fused) \
+   X(ps_drt_v) X(ps_drt_h) X(ps_bar_detector) X(ps_threshold_jet) X(ps_threshold_planes) X(ps_bar_threshold) \
+   X(ps_drt_v_region) X(ps_drt_h_region) X(ps_bar_detector_region) \
+   X(ps_drt_v_batch) X(ps_drt_h_batch) X(ps_bar_detector_batch) X(ps_threshold_jet_batch) \
+   X(pdrt2_v) X(pdrt2_h) X(pdrt2_bar_detector) X(pdrt2_threshold_jet) X(pdrt2_threshold_planes) \
+   X(pdrt2_bar_threshold) \
+   X(pdrt2_v_region) X(pdrt2_h_region) X(pdrt2_bar_detector_region) \
+   X(pdrt2_v_batch) X(pdrt2_h_batch) X(pdrt2_bar_detector_batch) X(pdrt2_threshold_jet_batch) \
+   X(pdrt32_v) X(pdrt32_h) X(pdrt32_bar_detector) X(pdrt32_threshold_jet) X(pdrt32_threshold_planes) \
+   X(pdrt32_bar_threshold) \
+   X(pdrt32_v_region) X(pdrt32_h_region) X(pdrt32_bar_detector_region) \
+   X(pdrt32_v_batch) X(pdrt32_h_batch) X(pdrt32_bar_detector_batch) X(pdrt32_threshold_jet_batch) \
+   X(partial_drt_16_4_v) X(partial_drt_16_4_h) X(partial_bar_detector_16_4) X(partial_threshold_jet_16_4) \
+   X(partial_threshold_planes_16_4) X(partial_bar_threshold_16_4) \
+   X(partial_drt_16_4_v_region) X(partial_drt_16_4_h_region) X(partial_bar_detector_16_4_region) \
+   X(partial_drt_16_4_v_batch) X(partial_drt_16_4_h_batch) X(partial_bar_detector_16_4_batch) \
+   X(partial_threshold_jet_16_4_batch) \
+   X(partial_drt_64_8_v) X(partial_drt_64_8_h) X(partial_bar_detector_64_8) X(partial_threshold_jet_64_8) \
+   X(partial_threshold_planes_64_8) X(partial_bar_threshold_64_8) \
+   X(partial_drt_64_8_v_region) X(partial_drt_64_8_h_region) X(partial_bar_detector_64_8_region) \
+   X(partial_drt_64_8_v_batch) X(partial_drt_64_8_h_batch) X(partial_bar_detector_64_8_batch) \
+   X(partial_threshold_jet_64_8_batch) \
+   X(preprocess_frame)
+
+enum class Stage {
+#define INSTRUMENTATION_ENUM(name) name,
+   INSTRUMENTATION_STAGES(INSTRUMENTATION_ENUM)
+#undef INSTRUMENTATION_ENUM
+   count
+};
+
+// Aggregated statistics of every thread, as aligned text or as JSON. Percentiles are the upper bounds of the
+// power-of-two nanosecond buckets they fall in
+std::string dump(bool json = false);
+
+// Clears the statistics of every thread. Durations recorded meanwhile may be kept
+void reset();
+
+#ifdef WITH_INSTRUMENTATION
+// Adds one duration to the histogram of the calling thread
+void record(Stage stage, long long nanoseconds);
+
+// Times its own lifetime
+class Timer {
+public:
+   explicit Timer(Stage stage);
+   ~Timer();
+
+private:
+   Stage stage;
+   long long start;
+};
+#endif
+
+}
+
+// INSTRUMENTED_AS takes the stage as an Instrumentation::Stage value, for calls through a table of pipelines
+#ifdef WITH_INSTRUMENTATION
+#define INSTRUMENTED(stage, ...) \
+   do { Instrumentation::Timer instrumentation_timer(Instrumentation::Stage::stage); __VA_ARGS__; } while (0)
+#define INSTRUMENTED_AS(stage, ...) \
+   do { Instrumentation::Timer instrumentation_timer(stage); __VA_ARGS__; } while (0)
+#else
+#define INSTRUMENTED(stage, ...) __VA_ARGS__
+#define INSTRUMENTED_AS(stage, ...) __VA_ARGS__
+#endif
+
+#endif //BARCODE_SEGMENTATION_INSTRUMENTATION_H
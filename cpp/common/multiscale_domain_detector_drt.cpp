@@ -15,66 +15,519 @@
 #include "convolutions_1.h"
 #include "convolutions_2.h"
 #include "convolutions_3.h"
+#ifdef WITH_SPARSE_UNPOOL
+#include "unpool_convolutions_0.h"
+#include "unpool_convolutions_1.h"
+#include "unpool_convolutions_2.h"
+#include "unpool_convolutions_3.h"
+#endif
 #include "argmaxth.h"
+#include "argmaxth_planes.h"
+#include "mdd_drt_v_region.h"
+#include "mdd_drt_h_region.h"
+#include "mdd_bar_detector_0_region.h"
+#include "mdd_bar_detector_1_region.h"
+#include "mdd_bar_detector_2_region.h"
+#include "mdd_bar_detector_3_region.h"
+#include "mdd_bar_detector_4_region.h"
+#ifdef WITH_BATCH
+#include "mdd_drt_v_batch.h"
+#include "mdd_drt_h_batch.h"
+#include "mdd_bar_detector_0_batch.h"
+#include "mdd_bar_detector_1_batch.h"
+#include "mdd_bar_detector_2_batch.h"
+#include "mdd_bar_detector_3_batch.h"
+#include "mdd_bar_detector_4_batch.h"
+#include "unpool_0_batch.h"
+#include "unpool_1_batch.h"
+#include "unpool_2_batch.h"
+#include "unpool_3_batch.h"
+#include "convolutions_0_batch.h"
+#include "convolutions_1_batch.h"
+#include "convolutions_2_batch.h"
+#include "convolutions_3_batch.h"
+#ifdef WITH_SPARSE_UNPOOL
+#include "unpool_convolutions_0_batch.h"
+#include "unpool_convolutions_1_batch.h"
+#include "unpool_convolutions_2_batch.h"
+#include "unpool_convolutions_3_batch.h"
+#endif
+#include "argmaxth_batch.h"
+#endif
 #include "image_utils.h"
+#include "drt_geometry.h"
+#include "stage_graph.h"
+#include "arena.h"
+#include "instrumentation.h"
+
+#include <algorithm>
+#include <array>
 
 namespace MDDDRT {
 
-Halide::Runtime::Buffer<int16_t> drt_v_0(1024, 3, 512);
-Halide::Runtime::Buffer<int16_t> drt_v_1(1024, 7, 256);
-Halide::Runtime::Buffer<int16_t> drt_v_2(1024, 15, 128);
-Halide::Runtime::Buffer<int16_t> drt_v_3(1024, 31, 64);
-Halide::Runtime::Buffer<int16_t> drt_v_4(1024, 63, 32);
+// The jet lookup tables are only read, so they are shared by all contexts
+Halide::Runtime::Buffer<uint8_t> jetr(ImageUtils::jet_r);
+Halide::Runtime::Buffer<uint8_t> jetg(ImageUtils::jet_g);
+Halide::Runtime::Buffer<uint8_t> jetb(ImageUtils::jet_b);
 
-Halide::Runtime::Buffer<int16_t> drt_h_0(1024, 3, 512);
-Halide::Runtime::Buffer<int16_t> drt_h_1(1024, 7, 256);
-Halide::Runtime::Buffer<int16_t> drt_h_2(1024, 15, 128);
-Halide::Runtime::Buffer<int16_t> drt_h_3(1024, 31, 64);
-Halide::Runtime::Buffer<int16_t> drt_h_4(1024, 63, 32);
+Context default_context;
 
-Halide::Runtime::Buffer<int16_t> encoder_0(6, 512, 512);
-Halide::Runtime::Buffer<int16_t> encoder_1(14, 256, 256);
-Halide::Runtime::Buffer<int16_t> encoder_2(30, 128, 128);
-Halide::Runtime::Buffer<int16_t> encoder_3(62, 64, 64);
-Halide::Runtime::Buffer<int16_t> encoder_4(126, 32, 32);
+// Whether the decoder runs the unpool_convolutions stages, which need no unpool buffers
+#ifdef WITH_SPARSE_UNPOOL
+const bool sparse_unpool = true;
+#else
+const bool sparse_unpool = false;
+#endif
 
-Halide::Runtime::Buffer<int16_t> unpool_buffer_3(62, 64, 64);
-Halide::Runtime::Buffer<int16_t> unpool_buffer_2(30, 128, 128);
-Halide::Runtime::Buffer<int16_t> unpool_buffer_1(30, 256, 256);
-Halide::Runtime::Buffer<int16_t> unpool_buffer_0(30, 512, 512);
+// Squares along a side of n pixels at the given stage (1 to 5)
+int n_squares(int n, int stage) {
+   return DRTGeometry::n_squares(n, 32, 32, stage);
+}
 
-Halide::Runtime::Buffer<int16_t> convolutions_buffer_3(62, 64, 64);
-Halide::Runtime::Buffer<int16_t> convolutions_buffer_2(30, 128, 128);
-Halide::Runtime::Buffer<int16_t> convolutions_buffer_1(30, 256, 256);
-Halide::Runtime::Buffer<int16_t> convolutions_buffer_0(30, 512, 512);
+// Lays out the working set in the arena when the input size, the number of frames or the layout changes. The
+// stages are those of run_stages(), in the same order, or those of run_concurrent() with their dependencies
+void Context::allocate(int width, int height, int frames, Layout layout) {
+   incremental = false;
+   bool same_size = width == allocated_width && height == allocated_height && frames == allocated_frames;
+   if (same_size && layout == allocated_layout)
+      return;
+   Halide::Runtime::Buffer<int16_t> *drt_v[5] = {&drt_v_0, &drt_v_1, &drt_v_2, &drt_v_3, &drt_v_4};
+   Halide::Runtime::Buffer<int16_t> *drt_h[5] = {&drt_h_0, &drt_h_1, &drt_h_2, &drt_h_3, &drt_h_4};
+   Halide::Runtime::Buffer<int16_t> *encoder[5] = {&encoder_0, &encoder_1, &encoder_2, &encoder_3, &encoder_4};
+   Halide::Runtime::Buffer<int16_t> *unpool[4] = {&unpool_buffer_0, &unpool_buffer_1, &unpool_buffer_2,
+                                                  &unpool_buffer_3};
+   Halide::Runtime::Buffer<int16_t> *convolutions[4] = {&convolutions_buffer_0, &convolutions_buffer_1,
+                                                        &convolutions_buffer_2, &convolutions_buffer_3};
+   // run_incremental() projects and encodes again only the changed tiles, the rest comes from the previous frame
+   bool keep_encoders = layout == Layout::incremental;
+   Arena::Plan plan;
+   std::vector<Halide::Runtime::Buffer<int16_t> *> buffers;
+   std::vector<std::vector<int>> extents;
+   auto add = [&](Halide::Runtime::Buffer<int16_t> *buffer, const std::vector<int> &buffer_extents, bool keep) {
+      size_t bytes = sizeof(int16_t);
+      for (int extent: buffer_extents)
+         bytes *= extent;
+      buffers.push_back(buffer);
+      extents.push_back(buffer_extents);
+      return plan.add_buffer(bytes, keep);
+   };
+   int v[5], h[5], e[5], u[4], c[4];
+   for (int i = 0; i < 5; i++) {
+      int stage = i + 1;
+      int n_slopes = DRTGeometry::n_slopes(stage);
+      v[i] = add(drt_v[i], {width, n_slopes, n_squares(height, stage), frames}, keep_encoders);
+      h[i] = add(drt_h[i], {height, n_slopes, n_squares(width, stage), frames}, keep_encoders);
+      e[i] = add(encoder[i], {2 * n_slopes, n_squares(width, stage), n_squares(height, stage), frames}, keep_encoders);
+   }
+   for (int i = 0; i < 4; i++) {
+      // The last decoder stage has the slopes of both encoders
+      int n_channels = i == 3 ? 62 : 30;
+      if (!sparse_unpool)
+         u[i] = add(unpool[i], {n_channels, n_squares(width, i + 1), n_squares(height, i + 1), frames}, false);
+      c[i] = add(convolutions[i], {n_channels, n_squares(width, i + 1), n_squares(height, i + 1), frames}, false);
+   }
+   auto stage = [&](const std::vector<int> &accessed, const std::vector<int> &dependencies) {
+      return layout == Layout::concurrent ? plan.add_stage(accessed, dependencies) : plan.add_stage(accessed);
+   };
+   int drt_v_stage = stage({v[0], v[1], v[2], v[3], v[4]}, {});
+   int drt_h_stage = stage({h[0], h[1], h[2], h[3], h[4]}, {});
+   int bar_stage[5];
+   for (int i = 0; i < 5; i++)
+      bar_stage[i] = stage({h[i], v[i], e[i]}, {drt_v_stage, drt_h_stage});
+   // Each decoder stage refines the last encoder, or the previous convolutions, onto the encoder of its stage
+   int convolutions_stage = bar_stage[4];
+   for (int i = 3; i >= 0; i--) {
+      int coarse = i == 3 ? e[4] : c[i + 1];
+      if (sparse_unpool) {
+         convolutions_stage = stage({coarse, e[i], c[i]}, {convolutions_stage, bar_stage[i]});
+      } else {
+         int unpool_stage = stage({coarse, e[i], u[i]}, {convolutions_stage, bar_stage[i]});
+         convolutions_stage = stage({u[i], c[i]}, {unpool_stage});
+      }
+   }
+   // argmaxth
+   stage({c[0]}, {convolutions_stage});
+   plan.place();
 
+   arena.resize(plan.size());
+   for (size_t i = 0; i < buffers.size(); i++)
+      *buffers[i] = arena.buffer<int16_t>(plan, (int) i, extents[i]);
+   if (!same_size) {
+      output_image = Halide::Runtime::Buffer<uint8_t>(n_squares(width, 1), n_squares(height, 1), 3, frames);
+      planes = Detections::allocate_planes(n_squares(width, 1), n_squares(height, 1), frames);
+   }
+   allocated_width = width;
+   allocated_height = height;
+   allocated_frames = frames;
+   allocated_layout = layout;
+}
 
-Halide::Runtime::Buffer<uint8_t> jetr(ImageUtils::jet_r);
-Halide::Runtime::Buffer<uint8_t> jetg(ImageUtils::jet_g);
-Halide::Runtime::Buffer<uint8_t> jetb(ImageUtils::jet_b);
-Halide::Runtime::Buffer<uint8_t> output_image(512, 512, 3);
+void Context::run_stages(Halide::Runtime::Buffer<uint8_t> &frames, double w_orig_3, double w_orig_2,
+                         double w_orig_1, double w_orig_0, double w_new_3, double w_new_2, double w_new_1,
+                         double w_new_0) {
+   INSTRUMENTED(mdd_drt_v, mdd_drt_v(frames, drt_v_0, drt_v_1, drt_v_2, drt_v_3, drt_v_4));
+   INSTRUMENTED(mdd_drt_h, mdd_drt_h(frames, drt_h_0, drt_h_1, drt_h_2, drt_h_3, drt_h_4));
+   INSTRUMENTED(mdd_bar_detector_0, mdd_bar_detector_0(drt_h_0, drt_v_0, encoder_0));
+   INSTRUMENTED(mdd_bar_detector_1, mdd_bar_detector_1(drt_h_1, drt_v_1, encoder_1));
+   INSTRUMENTED(mdd_bar_detector_2, mdd_bar_detector_2(drt_h_2, drt_v_2, encoder_2));
+   INSTRUMENTED(mdd_bar_detector_3, mdd_bar_detector_3(drt_h_3, drt_v_3, encoder_3));
+   INSTRUMENTED(mdd_bar_detector_4, mdd_bar_detector_4(drt_h_4, drt_v_4, encoder_4));
+   run_decoder(w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0);
+}
+
+void Context::run_decoder(double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0, double w_new_3,
+                          double w_new_2, double w_new_1, double w_new_0) {
+#ifdef WITH_SPARSE_UNPOOL
+   INSTRUMENTED(unpool_convolutions_3,
+                unpool_convolutions_3(encoder_4, encoder_3, w_new_3, w_orig_3, convolutions_buffer_3));
+   INSTRUMENTED(unpool_convolutions_2,
+                unpool_convolutions_2(convolutions_buffer_3, encoder_2, w_new_2, w_orig_2, convolutions_buffer_2));
+   INSTRUMENTED(unpool_convolutions_1,
+                unpool_convolutions_1(convolutions_buffer_2, encoder_1, w_new_1, w_orig_1, convolutions_buffer_1));
+   INSTRUMENTED(unpool_convolutions_0,
+                unpool_convolutions_0(convolutions_buffer_1, encoder_0, w_new_0, w_orig_0, convolutions_buffer_0));
+#else
+   INSTRUMENTED(unpool_3, unpool_3(encoder_4, encoder_3, w_new_3, w_orig_3, unpool_buffer_3));
+   INSTRUMENTED(convolutions_3, convolutions_3(unpool_buffer_3, convolutions_buffer_3));
+   INSTRUMENTED(unpool_2, unpool_2(convolutions_buffer_3, encoder_2, w_new_2, w_orig_2, unpool_buffer_2));
+   INSTRUMENTED(convolutions_2, convolutions_2(unpool_buffer_2, convolutions_buffer_2));
+   INSTRUMENTED(unpool_1, unpool_1(convolutions_buffer_2, encoder_1, w_new_1, w_orig_1, unpool_buffer_1));
+   INSTRUMENTED(convolutions_1, convolutions_1(unpool_buffer_1, convolutions_buffer_1));
+   INSTRUMENTED(unpool_0, unpool_0(convolutions_buffer_1, encoder_0, w_new_0, w_orig_0, unpool_buffer_0));
+   INSTRUMENTED(convolutions_0, convolutions_0(unpool_buffer_0, convolutions_buffer_0));
+#endif
+}
+
+// Crops of the five outputs of a DRT that recompute the lines of a dirty span. The span covers the tiles
+// [begin, end) along the projected lines, in the band of tiles `band` across them. A line of the last stage drifts
+// up to 31 pixels from where it starts, and stage k + 1 reads the positions of stage k up to 2^k away and its
+// squares 2y and 2y + 1, so the crops grow from the last stage to the first one.
+std::array<Halide::Runtime::Buffer<int16_t>, 5> crop_drt(Halide::Runtime::Buffer<int16_t> *drt[5],
+                                                        const DirtyTiles::Span &span) {
+   const int tile = DirtyTiles::tile_size;
+   int n_write = drt[0]->dim(0).extent();
+   int write_begin[5], write_end[5], square_begin[5], square_end[5];
+   for (int i = 4; i >= 0; i--) {
+      int stage = i + 1;
+      int n_squares = drt[i]->dim(2).extent();
+      write_begin[i] = span.begin * tile - tile;
+      write_end[i] = span.end * tile + tile;
+      square_begin[i] = std::min((span.band * tile) >> stage, n_squares - 1);
+      square_end[i] = std::max(std::min(((span.band + 1) * tile) >> stage, n_squares), square_begin[i] + 1);
+      if (i < 4) {
+         write_begin[i] = std::min(write_begin[i], write_begin[i + 1] - (1 << stage));
+         write_end[i] = std::max(write_end[i], write_end[i + 1] + (1 << stage));
+         square_begin[i] = std::min(square_begin[i], 2 * square_begin[i + 1]);
+         square_end[i] = std::max(square_end[i], std::min(2 * square_end[i + 1], n_squares));
+      }
+      write_begin[i] = std::max(write_begin[i], 0);
+      write_end[i] = std::min(write_end[i], n_write);
+      // The region libraries vectorize the line positions by 16
+      if (write_end[i] - write_begin[i] < 16) {
+         write_end[i] = std::min(write_begin[i] + 16, n_write);
+         write_begin[i] = std::max(write_end[i] - 16, 0);
+      }
+   }
+   std::array<Halide::Runtime::Buffer<int16_t>, 5> crops;
+   for (int i = 0; i < 5; i++)
+      crops[i] = drt[i]->cropped(0, write_begin[i], write_end[i] - write_begin[i])
+         .cropped(2, square_begin[i], square_end[i] - square_begin[i]);
+   return crops;
+}
+
+// Runs the region library of the bar detector of the given stage on the squares covering the pixels
+// [x_begin, x_end) x [y_begin, y_end), if any
+void update_encoder(int stage, Halide::Runtime::Buffer<int16_t> &drt_h, Halide::Runtime::Buffer<int16_t> &drt_v,
+                    Halide::Runtime::Buffer<int16_t> &encoder, int x_begin, int x_end, int y_begin, int y_end) {
+   int square_x_begin = std::max(x_begin, 0) >> stage;
+   int square_x_end = std::min((x_end + (1 << stage) - 1) >> stage, encoder.dim(1).extent());
+   int square_y_begin = std::max(y_begin, 0) >> stage;
+   int square_y_end = std::min((y_end + (1 << stage) - 1) >> stage, encoder.dim(2).extent());
+   if (square_x_begin >= square_x_end || square_y_begin >= square_y_end)
+      return;
+   Halide::Runtime::Buffer<int16_t> crop = encoder.cropped(1, square_x_begin, square_x_end - square_x_begin)
+      .cropped(2, square_y_begin, square_y_end - square_y_begin);
+   switch (stage) {
+      case 1: INSTRUMENTED(mdd_bar_detector_0_region, mdd_bar_detector_0_region(drt_h, drt_v, crop)); break;
+      case 2: INSTRUMENTED(mdd_bar_detector_1_region, mdd_bar_detector_1_region(drt_h, drt_v, crop)); break;
+      case 3: INSTRUMENTED(mdd_bar_detector_2_region, mdd_bar_detector_2_region(drt_h, drt_v, crop)); break;
+      case 4: INSTRUMENTED(mdd_bar_detector_3_region, mdd_bar_detector_3_region(drt_h, drt_v, crop)); break;
+      default: INSTRUMENTED(mdd_bar_detector_4_region, mdd_bar_detector_4_region(drt_h, drt_v, crop)); break;
+   }
+}
+
+void Context::update_dirty(Halide::Runtime::Buffer<uint8_t> &frames) {
+   const int tile = DirtyTiles::tile_size;
+   // Encoder squares read the DRT lines up to 80 pixels before their start and 48 pixels after it
+   const int margin = 3 * tile;
+   Halide::Runtime::Buffer<int16_t> *drt_v[5] = {&drt_v_0, &drt_v_1, &drt_v_2, &drt_v_3, &drt_v_4};
+   Halide::Runtime::Buffer<int16_t> *drt_h[5] = {&drt_h_0, &drt_h_1, &drt_h_2, &drt_h_3, &drt_h_4};
+   Halide::Runtime::Buffer<int16_t> *encoder[5] = {&encoder_0, &encoder_1, &encoder_2, &encoder_3, &encoder_4};
+   // The vertical DRT projects along the rows, its squares are bands of rows
+   std::vector<DirtyTiles::Span> row_spans = tracker.row_spans();
+   std::vector<DirtyTiles::Span> column_spans = tracker.column_spans();
+   for (const DirtyTiles::Span &span: row_spans) {
+      auto crops = crop_drt(drt_v, span);
+      INSTRUMENTED(mdd_drt_v_region, mdd_drt_v_region(frames, crops[0], crops[1], crops[2], crops[3], crops[4]));
+   }
+   for (const DirtyTiles::Span &span: column_spans) {
+      auto crops = crop_drt(drt_h, span);
+      INSTRUMENTED(mdd_drt_h_region, mdd_drt_h_region(frames, crops[0], crops[1], crops[2], crops[3], crops[4]));
+   }
+   for (int i = 0; i < 5; i++) {
+      for (const DirtyTiles::Span &span: row_spans)
+         update_encoder(i + 1, *drt_h[i], *drt_v[i], *encoder[i], span.begin * tile - margin,
+                        span.end * tile + margin, span.band * tile, (span.band + 1) * tile);
+      for (const DirtyTiles::Span &span: column_spans)
+         update_encoder(i + 1, *drt_h[i], *drt_v[i], *encoder[i], span.band * tile, (span.band + 1) * tile,
+                        span.begin * tile - margin, span.end * tile + margin);
+   }
+}
+
+Halide::Runtime::Buffer<uint8_t> Context::run(Halide::Runtime::Buffer<uint8_t> &input,
+                                              double w_orig_3, double w_orig_2, double w_orig_1,
+                                              double w_orig_0, double w_new_3, double w_new_2,
+                                              double w_new_1, double w_new_0, double threshold) {
+   allocate(input.width(), input.height(), 1);
+   Halide::Runtime::Buffer<uint8_t> output = output_image.sliced(3, 0);
+   run_into(input, output, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0, threshold);
+   return output;
+}
+
+void Context::run_into(Halide::Runtime::Buffer<uint8_t> &input, Halide::Runtime::Buffer<uint8_t> &output,
+                       double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0, double w_new_3,
+                       double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   allocate(input.width(), input.height(), 1);
+   // The pipelines work on stacks of frames, a single image is a stack of one
+   Halide::Runtime::Buffer<uint8_t> frames = input.embedded(2);
+   run_stages(frames, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0);
+   Halide::Runtime::Buffer<uint8_t> output_frames = output.embedded(3);
+   INSTRUMENTED(argmaxth, argmaxth(convolutions_buffer_0, jetr, jetg, jetb, threshold, output_frames));
+}
+
+const Detections::Planes &Context::run_planes(Halide::Runtime::Buffer<uint8_t> &input,
+                                              double w_orig_3, double w_orig_2, double w_orig_1,
+                                              double w_orig_0, double w_new_3, double w_new_2,
+                                              double w_new_1, double w_new_0, double threshold) {
+   allocate(input.width(), input.height(), 1);
+   Halide::Runtime::Buffer<uint8_t> frames = input.embedded(2);
+   run_stages(frames, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0);
+   INSTRUMENTED(argmaxth_planes,
+                argmaxth_planes(convolutions_buffer_0, threshold, planes.angles, planes.scores, planes.mask));
+   return planes;
+}
+
+const std::vector<Detections::Detection> &Context::detect(Halide::Runtime::Buffer<uint8_t> &input,
+                                                          double w_orig_3, double w_orig_2, double w_orig_1,
+                                                          double w_orig_0, double w_new_3, double w_new_2,
+                                                          double w_new_1, double w_new_0, double threshold,
+                                                          int min_area) {
+   run_planes(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0, threshold);
+   // The output squares are the ones of the first stage, 2x2 pixels each
+   return extractor.extract(planes, 0, 2, 2, min_area);
+}
+
+Halide::Runtime::Buffer<uint8_t> Context::run_concurrent(Halide::Runtime::Buffer<uint8_t> &input,
+                                                         double w_orig_3, double w_orig_2, double w_orig_1,
+                                                         double w_orig_0, double w_new_3, double w_new_2,
+                                                         double w_new_1, double w_new_0, double threshold) {
+   allocate(input.width(), input.height(), 1, Layout::concurrent);
+   Halide::Runtime::Buffer<uint8_t> frames = input.embedded(2);
+   StageGraph::Graph graph;
+   int v = graph.add([&]() {
+      INSTRUMENTED(mdd_drt_v, mdd_drt_v(frames, drt_v_0, drt_v_1, drt_v_2, drt_v_3, drt_v_4));
+   });
+   int h = graph.add([&]() {
+      INSTRUMENTED(mdd_drt_h, mdd_drt_h(frames, drt_h_0, drt_h_1, drt_h_2, drt_h_3, drt_h_4));
+   });
+   int bar_0 = graph.add([&]() {
+      INSTRUMENTED(mdd_bar_detector_0, mdd_bar_detector_0(drt_h_0, drt_v_0, encoder_0));
+   }, {v, h});
+   int bar_1 = graph.add([&]() {
+      INSTRUMENTED(mdd_bar_detector_1, mdd_bar_detector_1(drt_h_1, drt_v_1, encoder_1));
+   }, {v, h});
+   int bar_2 = graph.add([&]() {
+      INSTRUMENTED(mdd_bar_detector_2, mdd_bar_detector_2(drt_h_2, drt_v_2, encoder_2));
+   }, {v, h});
+   int bar_3 = graph.add([&]() {
+      INSTRUMENTED(mdd_bar_detector_3, mdd_bar_detector_3(drt_h_3, drt_v_3, encoder_3));
+   }, {v, h});
+   int bar_4 = graph.add([&]() {
+      INSTRUMENTED(mdd_bar_detector_4, mdd_bar_detector_4(drt_h_4, drt_v_4, encoder_4));
+   }, {v, h});
+#ifdef WITH_SPARSE_UNPOOL
+   int conv_3 = graph.add([&]() {
+      INSTRUMENTED(unpool_convolutions_3,
+                   unpool_convolutions_3(encoder_4, encoder_3, w_new_3, w_orig_3, convolutions_buffer_3));
+   }, {bar_3, bar_4});
+   int conv_2 = graph.add([&]() {
+      INSTRUMENTED(unpool_convolutions_2,
+                   unpool_convolutions_2(convolutions_buffer_3, encoder_2, w_new_2, w_orig_2, convolutions_buffer_2));
+   }, {conv_3, bar_2});
+   int conv_1 = graph.add([&]() {
+      INSTRUMENTED(unpool_convolutions_1,
+                   unpool_convolutions_1(convolutions_buffer_2, encoder_1, w_new_1, w_orig_1, convolutions_buffer_1));
+   }, {conv_2, bar_1});
+   int conv_0 = graph.add([&]() {
+      INSTRUMENTED(unpool_convolutions_0,
+                   unpool_convolutions_0(convolutions_buffer_1, encoder_0, w_new_0, w_orig_0, convolutions_buffer_0));
+   }, {conv_1, bar_0});
+#else
+   int up_3 = graph.add([&]() {
+      INSTRUMENTED(unpool_3, unpool_3(encoder_4, encoder_3, w_new_3, w_orig_3, unpool_buffer_3));
+   }, {bar_3, bar_4});
+   int conv_3 = graph.add([&]() {
+      INSTRUMENTED(convolutions_3, convolutions_3(unpool_buffer_3, convolutions_buffer_3));
+   }, {up_3});
+   int up_2 = graph.add([&]() {
+      INSTRUMENTED(unpool_2, unpool_2(convolutions_buffer_3, encoder_2, w_new_2, w_orig_2, unpool_buffer_2));
+   }, {conv_3, bar_2});
+   int conv_2 = graph.add([&]() {
+      INSTRUMENTED(convolutions_2, convolutions_2(unpool_buffer_2, convolutions_buffer_2));
+   }, {up_2});
+   int up_1 = graph.add([&]() {
+      INSTRUMENTED(unpool_1, unpool_1(convolutions_buffer_2, encoder_1, w_new_1, w_orig_1, unpool_buffer_1));
+   }, {conv_2, bar_1});
+   int conv_1 = graph.add([&]() {
+      INSTRUMENTED(convolutions_1, convolutions_1(unpool_buffer_1, convolutions_buffer_1));
+   }, {up_1});
+   int up_0 = graph.add([&]() {
+      INSTRUMENTED(unpool_0, unpool_0(convolutions_buffer_1, encoder_0, w_new_0, w_orig_0, unpool_buffer_0));
+   }, {conv_1, bar_0});
+   int conv_0 = graph.add([&]() {
+      INSTRUMENTED(convolutions_0, convolutions_0(unpool_buffer_0, convolutions_buffer_0));
+   }, {up_0});
+#endif
+   graph.add([&]() {
+      INSTRUMENTED(argmaxth, argmaxth(convolutions_buffer_0, jetr, jetg, jetb, threshold, output_image));
+   }, {conv_0});
+   graph.run();
+   return output_image.sliced(3, 0);
+}
+
+void Context::update_rois(Halide::Runtime::Buffer<uint8_t> &frames, const std::vector<ROI::Rect> &rois) {
+   // The encoders read the DRT lines up to 80 pixels around their squares, 3 tiles cover it
+   const int halo_tiles = 3;
+   // The decoder reads the encoder squares up to 90 pixels around an output square: 4, 8, 16 and 32 pixels for the
+   // convolutions of its four stages, plus the rounding to the coarser squares unpool reads. The encoders are computed
+   // 4 tiles around the regions, so the output in the regions is that of run()
+   const int decoder_halo = 4 * DirtyTiles::tile_size;
+   Halide::Runtime::Buffer<int16_t> *drt_v[5] = {&drt_v_0, &drt_v_1, &drt_v_2, &drt_v_3, &drt_v_4};
+   Halide::Runtime::Buffer<int16_t> *drt_h[5] = {&drt_h_0, &drt_h_1, &drt_h_2, &drt_h_3, &drt_h_4};
+   Halide::Runtime::Buffer<int16_t> *encoder[5] = {&encoder_0, &encoder_1, &encoder_2, &encoder_3, &encoder_4};
+   std::vector<ROI::Rect> encoded;
+   for (const ROI::Rect &rect: rois) {
+      encoded.push_back({rect.x - decoder_halo, rect.y - decoder_halo, rect.width + 2 * decoder_halo,
+                         rect.height + 2 * decoder_halo});
+   }
+   roi_tiles.mark(encoded, frames.dim(0).extent(), frames.dim(1).extent());
+   for (DirtyTiles::Span span: roi_tiles.row_spans()) {
+      span.begin -= halo_tiles;
+      span.end += halo_tiles;
+      auto crops = crop_drt(drt_v, span);
+      INSTRUMENTED(mdd_drt_v_region, mdd_drt_v_region(frames, crops[0], crops[1], crops[2], crops[3], crops[4]));
+   }
+   for (DirtyTiles::Span span: roi_tiles.column_spans()) {
+      span.begin -= halo_tiles;
+      span.end += halo_tiles;
+      auto crops = crop_drt(drt_h, span);
+      INSTRUMENTED(mdd_drt_h_region, mdd_drt_h_region(frames, crops[0], crops[1], crops[2], crops[3], crops[4]));
+   }
+   for (int i = 0; i < 5; i++) {
+      encoder[i]->fill(0);
+      for (const ROI::Rect &rect: encoded)
+         update_encoder(i + 1, *drt_h[i], *drt_v[i], *encoder[i], rect.x, rect.x + rect.width, rect.y,
+                        rect.y + rect.height);
+   }
+}
+
+Halide::Runtime::Buffer<uint8_t> Context::run_roi(Halide::Runtime::Buffer<uint8_t> &input,
+                                                  const std::vector<ROI::Rect> &rois,
+                                                  double w_orig_3, double w_orig_2, double w_orig_1,
+                                                  double w_orig_0, double w_new_3, double w_new_2,
+                                                  double w_new_1, double w_new_0, double threshold) {
+   allocate(input.width(), input.height(), 1);
+   Halide::Runtime::Buffer<uint8_t> frames = input.embedded(2);
+   update_rois(frames, rois);
+   run_decoder(w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0);
+   INSTRUMENTED(argmaxth, argmaxth(convolutions_buffer_0, jetr, jetg, jetb, threshold, output_image));
+   Halide::Runtime::Buffer<uint8_t> output = output_image.sliced(3, 0);
+   // The output squares are the ones of the first stage, 2x2 pixels each
+   ROI::zero_outside(output, rois, 2, 2);
+   return output;
+}
+
+Halide::Runtime::Buffer<uint8_t> Context::run_incremental(Halide::Runtime::Buffer<uint8_t> &input,
+                                                          double w_orig_3, double w_orig_2, double w_orig_1,
+                                                          double w_orig_0, double w_new_3, double w_new_2,
+                                                          double w_new_1, double w_new_0, double threshold,
+                                                          int change_threshold) {
+   // The intermediates only match the previous frame when no other entry point ran in between
+   bool reusable = incremental;
+   bool comparable = tracker.update(input, change_threshold);
+   allocate(input.width(), input.height(), 1, Layout::incremental);
+   incremental = true;
+   Halide::Runtime::Buffer<uint8_t> frames = input.embedded(2);
+   if (!reusable || !comparable) {
+      run_stages(frames, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0);
+   } else {
+      update_dirty(frames);
+      run_decoder(w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0);
+   }
+   INSTRUMENTED(argmaxth, argmaxth(convolutions_buffer_0, jetr, jetg, jetb, threshold, output_image));
+   return output_image.sliced(3, 0);
+}
+
+#ifdef WITH_BATCH
+Halide::Runtime::Buffer<uint8_t> Context::run_batch(Halide::Runtime::Buffer<uint8_t> &frames,
+                                                    double w_orig_3, double w_orig_2, double w_orig_1,
+                                                    double w_orig_0, double w_new_3, double w_new_2,
+                                                    double w_new_1, double w_new_0, double threshold) {
+   allocate(frames.dim(0).extent(), frames.dim(1).extent(), frames.dim(2).extent());
+   INSTRUMENTED(mdd_drt_v_batch, mdd_drt_v_batch(frames, drt_v_0, drt_v_1, drt_v_2, drt_v_3, drt_v_4));
+   INSTRUMENTED(mdd_drt_h_batch, mdd_drt_h_batch(frames, drt_h_0, drt_h_1, drt_h_2, drt_h_3, drt_h_4));
+   INSTRUMENTED(mdd_bar_detector_0_batch, mdd_bar_detector_0_batch(drt_h_0, drt_v_0, encoder_0));
+   INSTRUMENTED(mdd_bar_detector_1_batch, mdd_bar_detector_1_batch(drt_h_1, drt_v_1, encoder_1));
+   INSTRUMENTED(mdd_bar_detector_2_batch, mdd_bar_detector_2_batch(drt_h_2, drt_v_2, encoder_2));
+   INSTRUMENTED(mdd_bar_detector_3_batch, mdd_bar_detector_3_batch(drt_h_3, drt_v_3, encoder_3));
+   INSTRUMENTED(mdd_bar_detector_4_batch, mdd_bar_detector_4_batch(drt_h_4, drt_v_4, encoder_4));
+#ifdef WITH_SPARSE_UNPOOL
+   INSTRUMENTED(unpool_convolutions_3_batch,
+                unpool_convolutions_3_batch(encoder_4, encoder_3, w_new_3, w_orig_3, convolutions_buffer_3));
+   INSTRUMENTED(unpool_convolutions_2_batch,
+                unpool_convolutions_2_batch(convolutions_buffer_3, encoder_2, w_new_2, w_orig_2,
+                                            convolutions_buffer_2));
+   INSTRUMENTED(unpool_convolutions_1_batch,
+                unpool_convolutions_1_batch(convolutions_buffer_2, encoder_1, w_new_1, w_orig_1,
+                                            convolutions_buffer_1));
+   INSTRUMENTED(unpool_convolutions_0_batch,
+                unpool_convolutions_0_batch(convolutions_buffer_1, encoder_0, w_new_0, w_orig_0,
+                                            convolutions_buffer_0));
+#else
+   INSTRUMENTED(unpool_3_batch, unpool_3_batch(encoder_4, encoder_3, w_new_3, w_orig_3, unpool_buffer_3));
+   INSTRUMENTED(convolutions_3_batch, convolutions_3_batch(unpool_buffer_3, convolutions_buffer_3));
+   INSTRUMENTED(unpool_2_batch, unpool_2_batch(convolutions_buffer_3, encoder_2, w_new_2, w_orig_2, unpool_buffer_2));
+   INSTRUMENTED(convolutions_2_batch, convolutions_2_batch(unpool_buffer_2, convolutions_buffer_2));
+   INSTRUMENTED(unpool_1_batch, unpool_1_batch(convolutions_buffer_2, encoder_1, w_new_1, w_orig_1, unpool_buffer_1));
+   INSTRUMENTED(convolutions_1_batch, convolutions_1_batch(unpool_buffer_1, convolutions_buffer_1));
+   INSTRUMENTED(unpool_0_batch, unpool_0_batch(convolutions_buffer_1, encoder_0, w_new_0, w_orig_0, unpool_buffer_0));
+   INSTRUMENTED(convolutions_0_batch, convolutions_0_batch(unpool_buffer_0, convolutions_buffer_0));
+#endif
+   INSTRUMENTED(argmaxth_batch, argmaxth_batch(convolutions_buffer_0, jetr, jetg, jetb, threshold, output_image));
+   return output_image;
+}
+#endif
+
+size_t Context::intermediate_bytes() const {
+   return arena.size();
+}
 
 Halide::Runtime::Buffer<uint8_t> run(Halide::Runtime::Buffer<uint8_t> &input,
                                      double w_orig_3, double w_orig_2, double w_orig_1,
                                      double w_orig_0, double w_new_3, double w_new_2,
                                      double w_new_1, double w_new_0, double threshold) {
-   mdd_drt_v(input, drt_v_0, drt_v_1, drt_v_2, drt_v_3, drt_v_4);
-   mdd_drt_h(input, drt_h_0, drt_h_1, drt_h_2, drt_h_3, drt_h_4);
-   mdd_bar_detector_0(drt_h_0, drt_v_0, encoder_0);
-   mdd_bar_detector_1(drt_h_1, drt_v_1, encoder_1);
-   mdd_bar_detector_2(drt_h_2, drt_v_2, encoder_2);
-   mdd_bar_detector_3(drt_h_3, drt_v_3, encoder_3);
-   mdd_bar_detector_4(drt_h_4, drt_v_4, encoder_4);
-   unpool_3(encoder_4, encoder_3, w_new_3, w_orig_3, unpool_buffer_3);
-   convolutions_3(unpool_buffer_3, convolutions_buffer_3);
-   unpool_2(convolutions_buffer_3, encoder_2, w_new_2, w_orig_2, unpool_buffer_2);
-   convolutions_2(unpool_buffer_2, convolutions_buffer_2);
-   unpool_1(convolutions_buffer_2, encoder_1, w_new_1, w_orig_1, unpool_buffer_1);
-   convolutions_1(unpool_buffer_1, convolutions_buffer_1);
-   unpool_0(convolutions_buffer_1, encoder_0, w_new_0, w_orig_0, unpool_buffer_0);
-   convolutions_0(unpool_buffer_0, convolutions_buffer_0);
-   argmaxth(convolutions_buffer_0, jetr, jetg, jetb, threshold, output_image);
-   return output_image;
+   return default_context.run(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0,
+                              threshold);
 }
 
 }
\ No newline at end of file
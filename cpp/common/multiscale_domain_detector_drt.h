@@ -4,9 +4,117 @@
 
 #include <HalideRuntime.h>
 #include <HalideBuffer.h>
+#include "arena.h"
+#include "detections.h"
+#include "dirty_tiles.h"
+#include "roi.h"
 
 namespace MDDDRT {
 
+// Working set of one MDD DRT pipeline. Contexts share nothing, so each thread can run its own one concurrently.
+// The image returned by run() is owned by the context and overwritten by its next call.
+class Context {
+public:
+   Halide::Runtime::Buffer<uint8_t> run(Halide::Runtime::Buffer<uint8_t> &input,
+                                        double w_orig_3 = 1.0, double w_orig_2 = 1.0, double w_orig_1 = 1.0,
+                                        double w_orig_0 = 1.0, double w_new_3 = 1.0, double w_new_2 = 1.0,
+                                        double w_new_1 = 1.0, double w_new_0 = 1.0, double threshold = 0.05);
+   // Same as run(), but the image is written to `output`, a (width / 2, height / 2, 3) buffer owned by the caller
+   void run_into(Halide::Runtime::Buffer<uint8_t> &input, Halide::Runtime::Buffer<uint8_t> &output,
+                 double w_orig_3 = 1.0, double w_orig_2 = 1.0, double w_orig_1 = 1.0, double w_orig_0 = 1.0,
+                 double w_new_3 = 1.0, double w_new_2 = 1.0, double w_new_1 = 1.0, double w_new_0 = 1.0,
+                 double threshold = 0.05);
+   // Angle index, score and packed mask planes of the output, without the jet coloring. Owned by the context
+   const Detections::Planes &run_planes(Halide::Runtime::Buffer<uint8_t> &input,
+                                        double w_orig_3 = 1.0, double w_orig_2 = 1.0, double w_orig_1 = 1.0,
+                                        double w_orig_0 = 1.0, double w_new_3 = 1.0, double w_new_2 = 1.0,
+                                        double w_new_1 = 1.0, double w_new_0 = 1.0, double threshold = 0.05);
+   // Connected regions of the thresholded output, in input pixels. The list is owned by the context
+   const std::vector<Detections::Detection> &detect(Halide::Runtime::Buffer<uint8_t> &input,
+                                                    double w_orig_3 = 1.0, double w_orig_2 = 1.0,
+                                                    double w_orig_1 = 1.0, double w_orig_0 = 1.0,
+                                                    double w_new_3 = 1.0, double w_new_2 = 1.0,
+                                                    double w_new_1 = 1.0, double w_new_0 = 1.0,
+                                                    double threshold = 0.05, int min_area = 1);
+   // Same as run(), but the two DRTs, the five bar detectors and then the decoder stages are started as soon as
+   // their inputs are ready, so independent stages run at the same time
+   Halide::Runtime::Buffer<uint8_t> run_concurrent(Halide::Runtime::Buffer<uint8_t> &input,
+                                                   double w_orig_3 = 1.0, double w_orig_2 = 1.0,
+                                                   double w_orig_1 = 1.0, double w_orig_0 = 1.0,
+                                                   double w_new_3 = 1.0, double w_new_2 = 1.0,
+                                                   double w_new_1 = 1.0, double w_new_0 = 1.0,
+                                                   double threshold = 0.05);
+   // Same as run() for consecutive frames of a video: only the 32x32 tiles whose mean absolute difference with the
+   // previous frame exceeds change_threshold are projected again by the DRTs, and only the encoder squares that read
+   // them are recomputed. The decoder always runs on the whole frame. The first frame, and any frame of a new size,
+   // are processed in full
+   Halide::Runtime::Buffer<uint8_t> run_incremental(Halide::Runtime::Buffer<uint8_t> &input,
+                                                    double w_orig_3 = 1.0, double w_orig_2 = 1.0,
+                                                    double w_orig_1 = 1.0, double w_orig_0 = 1.0,
+                                                    double w_new_3 = 1.0, double w_new_2 = 1.0,
+                                                    double w_new_1 = 1.0, double w_new_0 = 1.0,
+                                                    double threshold = 0.05, int change_threshold = 4);
+   // Same as run() in the regions of interest, and zero outside them. The DRTs and the bar detectors only compute the
+   // squares within 128 pixels of the regions, the halo the decoder reads, and the DRT lines these squares read. The
+   // decoder runs on the whole frame
+   Halide::Runtime::Buffer<uint8_t> run_roi(Halide::Runtime::Buffer<uint8_t> &input, const std::vector<ROI::Rect> &rois,
+                                            double w_orig_3 = 1.0, double w_orig_2 = 1.0, double w_orig_1 = 1.0,
+                                            double w_orig_0 = 1.0, double w_new_3 = 1.0, double w_new_2 = 1.0,
+                                            double w_new_1 = 1.0, double w_new_0 = 1.0, double threshold = 0.05);
+#ifdef WITH_BATCH
+   // Processes a (width, height, frames) stack of images and returns a (width / 2, height / 2, 3, frames) image
+   Halide::Runtime::Buffer<uint8_t> run_batch(Halide::Runtime::Buffer<uint8_t> &frames,
+                                              double w_orig_3 = 1.0, double w_orig_2 = 1.0, double w_orig_1 = 1.0,
+                                              double w_orig_0 = 1.0, double w_new_3 = 1.0, double w_new_2 = 1.0,
+                                              double w_new_1 = 1.0, double w_new_0 = 1.0, double threshold = 0.05);
+#endif
+   // Bytes of the intermediates in the arena. Buffers that are never live at the same time share their bytes, so this
+   // is well below their sum for run(), less so for run_concurrent() and run_incremental()
+   size_t intermediate_bytes() const;
+
+private:
+   // Lifetimes the intermediates are laid out for: the stages of run() one after the other, those of run_concurrent()
+   // overlapping, or those of run_incremental(), which keep the DRTs and the encoders from one frame to the next
+   enum class Layout {
+      sequential,
+      concurrent,
+      incremental
+   };
+
+   void allocate(int width, int height, int frames, Layout layout = Layout::sequential);
+   // Runs every stage up to the last convolutions on a stack of one frame
+   void run_stages(Halide::Runtime::Buffer<uint8_t> &frames, double w_orig_3, double w_orig_2, double w_orig_1,
+                   double w_orig_0, double w_new_3, double w_new_2, double w_new_1, double w_new_0);
+   // Runs the unpool and convolution stages on the encoders
+   void run_decoder(double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0, double w_new_3,
+                    double w_new_2, double w_new_1, double w_new_0);
+   // Recomputes the DRT lines and the encoder squares that depend on the dirty tiles
+   void update_dirty(Halide::Runtime::Buffer<uint8_t> &frames);
+   // Computes the DRT lines and the encoder squares the regions of interest need, and zeroes the other encoder squares
+   void update_rois(Halide::Runtime::Buffer<uint8_t> &frames, const std::vector<ROI::Rect> &rois);
+
+   // Views over the arena
+   Halide::Runtime::Buffer<int16_t> drt_v_0, drt_v_1, drt_v_2, drt_v_3, drt_v_4;
+   Halide::Runtime::Buffer<int16_t> drt_h_0, drt_h_1, drt_h_2, drt_h_3, drt_h_4;
+   Halide::Runtime::Buffer<int16_t> encoder_0, encoder_1, encoder_2, encoder_3, encoder_4;
+   Halide::Runtime::Buffer<int16_t> unpool_buffer_3, unpool_buffer_2, unpool_buffer_1, unpool_buffer_0;
+   Halide::Runtime::Buffer<int16_t> convolutions_buffer_3, convolutions_buffer_2, convolutions_buffer_1,
+      convolutions_buffer_0;
+   Arena::Slab arena;
+   Halide::Runtime::Buffer<uint8_t> output_image;
+   Detections::Planes planes;
+   Detections::Extractor extractor;
+   DirtyTiles::Tracker tracker;
+   DirtyTiles::Tracker roi_tiles;
+   // Whether the intermediates were left by run_incremental(), every other entry point clears it
+   bool incremental = false;
+   int allocated_width = 0;
+   int allocated_height = 0;
+   int allocated_frames = 0;
+   Layout allocated_layout = Layout::sequential;
+};
+
+// Runs on a context shared by all callers, not reentrant
 Halide::Runtime::Buffer<uint8_t> run(Halide::Runtime::Buffer<uint8_t> &input,
                                      double w_orig_3 = 1.0, double w_orig_2 = 1.0, double w_orig_1 = 1.0,
                                      double w_orig_0 = 1.0, double w_new_3 = 1.0, double w_new_2 = 1.0,
@@ -0,0 +1,46 @@
+#include "multiscale_domain_detector_fused.h"
+
+#include "mdd_fused.h"
+#include "image_utils.h"
+#include "drt_geometry.h"
+#include "instrumentation.h"
+
+namespace MDDFused {
+
+Halide::Runtime::Buffer<uint8_t> jetr(ImageUtils::jet_r);
+Halide::Runtime::Buffer<uint8_t> jetg(ImageUtils::jet_g);
+Halide::Runtime::Buffer<uint8_t> jetb(ImageUtils::jet_b);
+
+Context default_context;
+
+Halide::Runtime::Buffer<uint8_t> Context::run(Halide::Runtime::Buffer<uint8_t> &input,
+                                              double w_orig_3, double w_orig_2, double w_orig_1,
+                                              double w_orig_0, double w_new_3, double w_new_2,
+                                              double w_new_1, double w_new_0, double threshold) {
+   int output_width = DRTGeometry::n_squares(input.width(), 32, 32, 1);
+   int output_height = DRTGeometry::n_squares(input.height(), 32, 32, 1);
+   if (output_image.width() != output_width || output_image.height() != output_height)
+      output_image = Halide::Runtime::Buffer<uint8_t>(output_width, output_height, 3, 1);
+   Halide::Runtime::Buffer<uint8_t> output = output_image.sliced(3, 0);
+   run_into(input, output, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0, threshold);
+   return output;
+}
+
+void Context::run_into(Halide::Runtime::Buffer<uint8_t> &input, Halide::Runtime::Buffer<uint8_t> &output,
+                       double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0, double w_new_3,
+                       double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   Halide::Runtime::Buffer<uint8_t> frames = input.embedded(2);
+   Halide::Runtime::Buffer<uint8_t> output_frames = output.embedded(3);
+   INSTRUMENTED(mdd_fused, mdd_fused(frames, jetr, jetg, jetb, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3,
+                                     w_new_2, w_new_1, w_new_0, threshold, output_frames));
+}
+
+Halide::Runtime::Buffer<uint8_t> run(Halide::Runtime::Buffer<uint8_t> &input,
+                                     double w_orig_3, double w_orig_2, double w_orig_1,
+                                     double w_orig_0, double w_new_3, double w_new_2,
+                                     double w_new_1, double w_new_0, double threshold) {
+   return default_context.run(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0,
+                              threshold);
+}
+
+}
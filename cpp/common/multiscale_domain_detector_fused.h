@@ -0,0 +1,36 @@
+#ifndef BARCODE_SEGMENTATION_MULTISCALE_DOMAIN_DETECTOR_FUSED_H
+#define BARCODE_SEGMENTATION_MULTISCALE_DOMAIN_DETECTOR_FUSED_H
+
+
+#include <HalideRuntime.h>
+#include <HalideBuffer.h>
+
+namespace MDDFused {
+
+// MDD DRT computed by the single mdd_fused pipeline. Same results as MDDDRT::Context, but only the output image is
+// kept between calls, the intermediates are allocated and reused by the pipeline itself.
+class Context {
+public:
+   Halide::Runtime::Buffer<uint8_t> run(Halide::Runtime::Buffer<uint8_t> &input,
+                                        double w_orig_3 = 1.0, double w_orig_2 = 1.0, double w_orig_1 = 1.0,
+                                        double w_orig_0 = 1.0, double w_new_3 = 1.0, double w_new_2 = 1.0,
+                                        double w_new_1 = 1.0, double w_new_0 = 1.0, double threshold = 0.05);
+   // Same as run(), but the image is written to `output`, a (width / 2, height / 2, 3) buffer owned by the caller
+   void run_into(Halide::Runtime::Buffer<uint8_t> &input, Halide::Runtime::Buffer<uint8_t> &output,
+                 double w_orig_3 = 1.0, double w_orig_2 = 1.0, double w_orig_1 = 1.0, double w_orig_0 = 1.0,
+                 double w_new_3 = 1.0, double w_new_2 = 1.0, double w_new_1 = 1.0, double w_new_0 = 1.0,
+                 double threshold = 0.05);
+
+private:
+   Halide::Runtime::Buffer<uint8_t> output_image;
+};
+
+// Runs on a context shared by all callers, not reentrant
+Halide::Runtime::Buffer<uint8_t> run(Halide::Runtime::Buffer<uint8_t> &input,
+                                     double w_orig_3 = 1.0, double w_orig_2 = 1.0, double w_orig_1 = 1.0,
+                                     double w_orig_0 = 1.0, double w_new_3 = 1.0, double w_new_2 = 1.0,
+                                     double w_new_1 = 1.0, double w_new_0 = 1.0, double threshold = 0.05);
+
+}
+
+#endif //BARCODE_SEGMENTATION_MULTISCALE_DOMAIN_DETECTOR_FUSED_H
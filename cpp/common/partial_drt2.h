@@ -1,13 +1,19 @@
 #ifndef BARCODE_SEGMENTATION_PARTIAL_DRT2_H
 #define BARCODE_SEGMENTATION_PARTIAL_DRT2_H
 
-#include <HalideRuntime.h>
-#include <HalideBuffer.h>
-
+#include "partial_drt_registry.h"
 
 namespace PDRT2 {
 
+// PartialDRT::Context of the PDRT 2, the partial strided DRT at tile size 2 and stride 2
+class Context : public PartialDRT::Context {
+public:
+   Context();
+};
+
+// Runs on a context shared by all callers, not reentrant
 Halide::Runtime::Buffer<uint8_t> run(Halide::Runtime::Buffer<uint8_t> &input);
 
 }
+
 #endif //BARCODE_SEGMENTATION_PARTIAL_DRT2_H
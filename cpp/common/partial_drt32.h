@@ -1,13 +1,19 @@
 #ifndef BARCODE_SEGMENTATION_PARTIAL_DRT32_H
 #define BARCODE_SEGMENTATION_PARTIAL_DRT32_H
 
-#include <HalideRuntime.h>
-#include <HalideBuffer.h>
-
+#include "partial_drt_registry.h"
 
 namespace PDRT32 {
 
+// PartialDRT::Context of the PDRT 32, the partial strided DRT at tile size 32 and stride 32
+class Context : public PartialDRT::Context {
+public:
+   Context();
+};
+
+// Runs on a context shared by all callers, not reentrant
 Halide::Runtime::Buffer<uint8_t> run(Halide::Runtime::Buffer<uint8_t> &input);
 
 }
+
 #endif //BARCODE_SEGMENTATION_PARTIAL_DRT32_H
@@ -0,0 +1,270 @@
+#include "partial_drt_registry.h"
+#include "ps_drt_v.h"
+#include "ps_drt_h.h"
+#include "ps_bar_detector.h"
+#include "ps_threshold_jet.h"
+#include "ps_threshold_planes.h"
+#include "ps_bar_threshold.h"
+#include "ps_drt_v_region.h"
+#include "ps_drt_h_region.h"
+#include "ps_bar_detector_region.h"
+#include "pdrt2_v.h"
+#include "pdrt2_h.h"
+#include "pdrt2_bar_detector.h"
+#include "pdrt2_threshold_jet.h"
+#include "pdrt2_threshold_planes.h"
+#include "pdrt2_bar_threshold.h"
+#include "pdrt2_v_region.h"
+#include "pdrt2_h_region.h"
+#include "pdrt2_bar_detector_region.h"
+#include "pdrt32_v.h"
+#include "pdrt32_h.h"
+#include "pdrt32_bar_detector.h"
+#include "pdrt32_threshold_jet.h"
+#include "pdrt32_threshold_planes.h"
+#include "pdrt32_bar_threshold.h"
+#include "pdrt32_v_region.h"
+#include "pdrt32_h_region.h"
+#include "pdrt32_bar_detector_region.h"
+#include "partial_drt_16_4_v.h"
+#include "partial_drt_16_4_h.h"
+#include "partial_bar_detector_16_4.h"
+#include "partial_threshold_jet_16_4.h"
+#include "partial_threshold_planes_16_4.h"
+#include "partial_bar_threshold_16_4.h"
+#include "partial_drt_16_4_v_region.h"
+#include "partial_drt_16_4_h_region.h"
+#include "partial_bar_detector_16_4_region.h"
+#include "partial_drt_64_8_v.h"
+#include "partial_drt_64_8_h.h"
+#include "partial_bar_detector_64_8.h"
+#include "partial_threshold_jet_64_8.h"
+#include "partial_threshold_planes_64_8.h"
+#include "partial_bar_threshold_64_8.h"
+#include "partial_drt_64_8_v_region.h"
+#include "partial_drt_64_8_h_region.h"
+#include "partial_bar_detector_64_8_region.h"
+#ifdef WITH_BATCH
+#include "ps_drt_v_batch.h"
+#include "ps_drt_h_batch.h"
+#include "ps_bar_detector_batch.h"
+#include "ps_threshold_jet_batch.h"
+#include "pdrt2_v_batch.h"
+#include "pdrt2_h_batch.h"
+#include "pdrt2_bar_detector_batch.h"
+#include "pdrt2_threshold_jet_batch.h"
+#include "pdrt32_v_batch.h"
+#include "pdrt32_h_batch.h"
+#include "pdrt32_bar_detector_batch.h"
+#include "pdrt32_threshold_jet_batch.h"
+#include "partial_drt_16_4_v_batch.h"
+#include "partial_drt_16_4_h_batch.h"
+#include "partial_bar_detector_16_4_batch.h"
+#include "partial_threshold_jet_16_4_batch.h"
+#include "partial_drt_64_8_v_batch.h"
+#include "partial_drt_64_8_h_batch.h"
+#include "partial_bar_detector_64_8_batch.h"
+#include "partial_threshold_jet_64_8_batch.h"
+#endif
+#include "image_utils.h"
+#include "drt_geometry.h"
+#include "instrumentation.h"
+#include <algorithm>
+#include <cmath>
+
+namespace PartialDRT {
+
+namespace {
+
+Halide::Runtime::Buffer<uint8_t> jetr(ImageUtils::jet_r);
+Halide::Runtime::Buffer<uint8_t> jetg(ImageUtils::jet_g);
+Halide::Runtime::Buffer<uint8_t> jetb(ImageUtils::jet_b);
+
+}
+
+int OperatingPoint::last_stage() const {
+   return DRTGeometry::last_stage(tile_size);
+}
+
+#ifdef WITH_BATCH
+#define BATCH_LIBRARY(name) name##_batch
+#else
+#define BATCH_LIBRARY(name) nullptr
+#endif
+
+// Row of operating_points(). The region and batch libraries and the instrumentation stages are named after the
+// pipelines
+#define OPERATING_POINT(name, tile_size, stride, drt_v, drt_h, bar_detector, threshold_jet, threshold_planes, \
+                        bar_threshold) \
+   {name, tile_size, stride, drt_v, drt_h, bar_detector, threshold_jet, threshold_planes, bar_threshold, \
+    drt_v##_region, drt_h##_region, bar_detector##_region, \
+    BATCH_LIBRARY(drt_v), BATCH_LIBRARY(drt_h), BATCH_LIBRARY(bar_detector), BATCH_LIBRARY(threshold_jet), \
+    {Instrumentation::Stage::drt_v, Instrumentation::Stage::drt_h, Instrumentation::Stage::bar_detector, \
+     Instrumentation::Stage::threshold_jet, Instrumentation::Stage::threshold_planes, \
+     Instrumentation::Stage::bar_threshold, Instrumentation::Stage::drt_v##_region, \
+     Instrumentation::Stage::drt_h##_region, Instrumentation::Stage::bar_detector##_region, \
+     Instrumentation::Stage::drt_v##_batch, Instrumentation::Stage::drt_h##_batch, \
+     Instrumentation::Stage::bar_detector##_batch, Instrumentation::Stage::threshold_jet##_batch}}
+
+const std::vector<OperatingPoint> &operating_points() {
+   static const std::vector<OperatingPoint> points = {
+      OPERATING_POINT("pdrt2", 2, 2, pdrt2_v, pdrt2_h, pdrt2_bar_detector, pdrt2_threshold_jet, pdrt2_threshold_planes,
+                      pdrt2_bar_threshold),
+      OPERATING_POINT("ps", 32, 2, ps_drt_v, ps_drt_h, ps_bar_detector, ps_threshold_jet, ps_threshold_planes,
+                      ps_bar_threshold),
+      OPERATING_POINT("partial_16_4", 16, 4, partial_drt_16_4_v, partial_drt_16_4_h, partial_bar_detector_16_4,
+                      partial_threshold_jet_16_4, partial_threshold_planes_16_4, partial_bar_threshold_16_4),
+      OPERATING_POINT("partial_64_8", 64, 8, partial_drt_64_8_v, partial_drt_64_8_h, partial_bar_detector_64_8,
+                      partial_threshold_jet_64_8, partial_threshold_planes_64_8, partial_bar_threshold_64_8),
+      OPERATING_POINT("pdrt32", 32, 32, pdrt32_v, pdrt32_h, pdrt32_bar_detector, pdrt32_threshold_jet,
+                      pdrt32_threshold_planes, pdrt32_bar_threshold),
+   };
+   return points;
+}
+
+#undef OPERATING_POINT
+#undef BATCH_LIBRARY
+
+const OperatingPoint *find(int tile_size, int stride) {
+   for (const OperatingPoint &point: operating_points()) {
+      if (point.tile_size == tile_size && point.stride == stride)
+         return &point;
+   }
+   return nullptr;
+}
+
+const OperatingPoint *find(const std::string &name) {
+   for (const OperatingPoint &point: operating_points()) {
+      if (point.name == name)
+         return &point;
+   }
+   return nullptr;
+}
+
+Context::Context(const OperatingPoint &point) : point(point) {
+}
+
+// (Re)allocates the working set when the input size or the number of frames changes
+void Context::allocate(int width, int height, int frames) {
+   if (width == allocated_width && height == allocated_height && frames == allocated_frames)
+      return;
+   int last_stage = point.last_stage();
+   int n_slopes_drt = DRTGeometry::n_slopes(last_stage);
+   int n_squares_x = DRTGeometry::n_squares(width, point.tile_size, point.stride, last_stage);
+   int n_squares_y = DRTGeometry::n_squares(height, point.tile_size, point.stride, last_stage);
+   drt_v = Halide::Runtime::Buffer<int16_t>(width, n_slopes_drt, n_squares_y, frames);
+   drt_h = Halide::Runtime::Buffer<int16_t>(height, n_slopes_drt, n_squares_x, frames);
+   intensities = Halide::Runtime::Buffer<int16_t>(n_squares_x, n_squares_y, frames);
+   slopes = Halide::Runtime::Buffer<int16_t>(n_squares_x, n_squares_y, frames);
+   output_image = Halide::Runtime::Buffer<uint8_t>(n_squares_x, n_squares_y, 3, frames);
+   planes = Detections::allocate_planes(n_squares_x, n_squares_y, frames);
+   peak = Halide::Runtime::Buffer<int16_t>(1);
+   allocated_width = width;
+   allocated_height = height;
+   allocated_frames = frames;
+}
+
+Halide::Runtime::Buffer<uint8_t> Context::run(Halide::Runtime::Buffer<uint8_t> &input) {
+   allocate(input.width(), input.height(), 1);
+   Halide::Runtime::Buffer<uint8_t> output = output_image.sliced(3, 0);
+   run_into(input, output);
+   return output;
+}
+
+void Context::run_into(Halide::Runtime::Buffer<uint8_t> &input, Halide::Runtime::Buffer<uint8_t> &output) {
+   allocate(input.width(), input.height(), 1);
+   // The pipelines work on stacks of frames, a single image is a stack of one
+   Halide::Runtime::Buffer<uint8_t> frames = input.embedded(2);
+   INSTRUMENTED_AS(point.stages.drt_v, point.drt_v(frames, drt_v));
+   INSTRUMENTED_AS(point.stages.drt_h, point.drt_h(frames, drt_h));
+   INSTRUMENTED_AS(point.stages.bar_detector, point.bar_detector(drt_h, drt_v, intensities, slopes));
+   Halide::Runtime::Buffer<uint8_t> output_frames = output.embedded(3);
+   INSTRUMENTED_AS(point.stages.threshold_jet,
+                   point.threshold_jet(intensities, slopes, jetr, jetg, jetb, output_frames));
+}
+
+bool Context::set_normalization(Normalization mode, float value) {
+   // Negated so that NaN is rejected too
+   if (mode == Normalization::moving_average && !(value > 0 && value <= 1))
+      return false;
+   if (mode == Normalization::fixed && !(value > 0 && std::isfinite(value)))
+      return false;
+   normalization = mode;
+   normalization_value = value;
+   average_intensity = 0;
+   return true;
+}
+
+const Detections::Planes &Context::run_planes(Halide::Runtime::Buffer<uint8_t> &input) {
+   allocate(input.width(), input.height(), 1);
+   Halide::Runtime::Buffer<uint8_t> frames = input.embedded(2);
+   INSTRUMENTED_AS(point.stages.drt_v, point.drt_v(frames, drt_v));
+   INSTRUMENTED_AS(point.stages.drt_h, point.drt_h(frames, drt_h));
+   float intensity = normalization == Normalization::fixed ? normalization_value : average_intensity;
+   if (normalization == Normalization::per_frame || intensity <= 0) {
+      INSTRUMENTED_AS(point.stages.bar_detector, point.bar_detector(drt_h, drt_v, intensities, slopes));
+      INSTRUMENTED_AS(point.stages.threshold_planes,
+                      point.threshold_planes(intensities, slopes, planes.angles, planes.scores, planes.mask));
+      if (normalization == Normalization::moving_average) {
+         // First frame: the average starts at its strongest square
+         average_intensity = *std::max_element(intensities.data(),
+                                               intensities.data() + intensities.number_of_elements());
+      }
+      return planes;
+   }
+   INSTRUMENTED_AS(point.stages.bar_threshold,
+                   point.bar_threshold(drt_h, drt_v, intensity, planes.angles, planes.scores, planes.mask, peak));
+   if (normalization == Normalization::moving_average)
+      average_intensity += normalization_value * (peak(0) - average_intensity);
+   return planes;
+}
+
+const std::vector<Detections::Detection> &Context::detect(Halide::Runtime::Buffer<uint8_t> &input, int min_area) {
+   return extractor.extract(run_planes(input), 0, point.stride, point.tile_size, min_area);
+}
+
+Halide::Runtime::Buffer<uint8_t> Context::run_roi(Halide::Runtime::Buffer<uint8_t> &input,
+                                                  const std::vector<ROI::Rect> &rois) {
+   allocate(input.width(), input.height(), 1);
+   Halide::Runtime::Buffer<uint8_t> frames = input.embedded(2);
+   // Squares with a zero intensity are below the threshold, so they are left black by the coloring
+   intensities.fill(0);
+   slopes.fill(0);
+   for (const ROI::Rect &rect: rois) {
+      ROI::Crops crops = ROI::crops(rect, input.width(), input.height(), point.tile_size, point.stride,
+                                    intensities.dim(0).extent(), intensities.dim(1).extent());
+      if (crops.empty())
+         continue;
+      Halide::Runtime::Buffer<int16_t> drt_v_crop = drt_v.cropped(0, crops.lines_x.begin, crops.lines_x.extent())
+         .cropped(2, crops.squares_y.begin, crops.squares_y.extent());
+      Halide::Runtime::Buffer<int16_t> drt_h_crop = drt_h.cropped(0, crops.lines_y.begin, crops.lines_y.extent())
+         .cropped(2, crops.squares_x.begin, crops.squares_x.extent());
+      Halide::Runtime::Buffer<int16_t> intensities_crop = intensities
+         .cropped(0, crops.squares_x.begin, crops.squares_x.extent())
+         .cropped(1, crops.squares_y.begin, crops.squares_y.extent());
+      Halide::Runtime::Buffer<int16_t> slopes_crop = slopes
+         .cropped(0, crops.squares_x.begin, crops.squares_x.extent())
+         .cropped(1, crops.squares_y.begin, crops.squares_y.extent());
+      INSTRUMENTED_AS(point.stages.drt_v_region, point.drt_v_region(frames, drt_v_crop));
+      INSTRUMENTED_AS(point.stages.drt_h_region, point.drt_h_region(frames, drt_h_crop));
+      INSTRUMENTED_AS(point.stages.bar_detector_region,
+                      point.bar_detector_region(drt_h, drt_v, intensities_crop, slopes_crop));
+   }
+   INSTRUMENTED_AS(point.stages.threshold_jet,
+                   point.threshold_jet(intensities, slopes, jetr, jetg, jetb, output_image));
+   return output_image.sliced(3, 0);
+}
+
+#ifdef WITH_BATCH
+Halide::Runtime::Buffer<uint8_t> Context::run_batch(Halide::Runtime::Buffer<uint8_t> &frames) {
+   allocate(frames.dim(0).extent(), frames.dim(1).extent(), frames.dim(2).extent());
+   INSTRUMENTED_AS(point.stages.drt_v_batch, point.drt_v_batch(frames, drt_v));
+   INSTRUMENTED_AS(point.stages.drt_h_batch, point.drt_h_batch(frames, drt_h));
+   INSTRUMENTED_AS(point.stages.bar_detector_batch, point.bar_detector_batch(drt_h, drt_v, intensities, slopes));
+   INSTRUMENTED_AS(point.stages.threshold_jet_batch,
+                   point.threshold_jet_batch(intensities, slopes, jetr, jetg, jetb, output_image));
+   return output_image;
+}
+#endif
+
+}
@@ -0,0 +1,125 @@
+#ifndef BARCODE_SEGMENTATION_PARTIAL_DRT_REGISTRY_H
+#define BARCODE_SEGMENTATION_PARTIAL_DRT_REGISTRY_H
+
+#include <string>
+#include <vector>
+#include <HalideRuntime.h>
+#include <HalideBuffer.h>
+#include "detections.h"
+#include "instrumentation.h"
+#include "roi.h"
+
+// Operating points of the partial strided DRT built from the partial_drt, partial_bar_detector,
+// partial_threshold_jet and threshold_planes generators: PS DRT, PDRT 2, PDRT 32 and the points listed in
+// partial_drt_points in host/CMakeLists.txt
+namespace PartialDRT {
+
+struct OperatingPoint {
+   using DRT = int (*)(halide_buffer_t *in, halide_buffer_t *out);
+   using BarDetector = int (*)(halide_buffer_t *drt_h, halide_buffer_t *drt_v, halide_buffer_t *intensities,
+                               halide_buffer_t *slopes);
+   using ThresholdJet = int (*)(halide_buffer_t *intensities, halide_buffer_t *slopes, halide_buffer_t *jet_r,
+                                halide_buffer_t *jet_g, halide_buffer_t *jet_b, halide_buffer_t *output);
+
+   std::string name;
+   int tile_size;
+   int stride;
+   DRT drt_v;
+   DRT drt_h;
+   BarDetector bar_detector;
+   ThresholdJet threshold_jet;
+   int (*threshold_planes)(halide_buffer_t *intensities, halide_buffer_t *slopes, halide_buffer_t *angles,
+                           halide_buffer_t *scores, halide_buffer_t *mask);
+   // Bar detector and threshold_planes in one pass, relative to a given normalization intensity
+   int (*bar_threshold)(halide_buffer_t *drt_h, halide_buffer_t *drt_v, float normalization, halide_buffer_t *angles,
+                        halide_buffer_t *scores, halide_buffer_t *mask, halide_buffer_t *peak);
+   // The *_region libraries of run_roi(), which compute cropped outputs
+   DRT drt_v_region;
+   DRT drt_h_region;
+   BarDetector bar_detector_region;
+   // The *_batch libraries of run_batch(), nullptr without WITH_BATCH
+   DRT drt_v_batch;
+   DRT drt_h_batch;
+   BarDetector bar_detector_batch;
+   ThresholdJet threshold_jet_batch;
+   // Instrumentation stages of the pipelines above
+   struct Stages {
+      Instrumentation::Stage drt_v, drt_h, bar_detector, threshold_jet, threshold_planes, bar_threshold;
+      Instrumentation::Stage drt_v_region, drt_h_region, bar_detector_region;
+      Instrumentation::Stage drt_v_batch, drt_h_batch, bar_detector_batch, threshold_jet_batch;
+   } stages;
+
+   // Last DRT stage, log2 of the tile size
+   int last_stage() const;
+};
+
+// Every operating point that was built, from the finest grid to the coarsest
+const std::vector<OperatingPoint> &operating_points();
+
+// nullptr when that operating point was not built
+const OperatingPoint *find(int tile_size, int stride);
+const OperatingPoint *find(const std::string &name);
+
+// Intensity the thresholds of run_planes() and detect() are relative to
+enum class Normalization {
+   // The strongest square of the frame: a reduction over the whole frame between the bar detector and the threshold
+   per_frame,
+   // Exponential moving average of the strongest square of the previous frames, for video. The bar detector and
+   // the threshold then run in one pass
+   moving_average,
+   // A fixed intensity, also in one pass
+   fixed
+};
+
+// Working set of one operating point. Contexts share nothing, so each thread can run its own one concurrently.
+// The buffers returned by the run functions are owned by the context and overwritten by its next call
+class Context {
+public:
+   explicit Context(const OperatingPoint &point);
+
+   const OperatingPoint &operating_point() const { return point; }
+
+   // `value` is the weight of the newest frame, in (0, 1], for moving_average, and the intensity, above 0, for fixed.
+   // It is ignored for per_frame. The first frame of a moving average is normalized by itself. Returns false, and
+   // keeps the previous normalization, when the value is out of range
+   bool set_normalization(Normalization mode, float value = 0);
+
+   Halide::Runtime::Buffer<uint8_t> run(Halide::Runtime::Buffer<uint8_t> &input);
+   // Same as run(), but the image is written to `output`, a (squares x, squares y, 3) buffer owned by the caller
+   void run_into(Halide::Runtime::Buffer<uint8_t> &input, Halide::Runtime::Buffer<uint8_t> &output);
+   // Angle index, score and packed mask planes of the output, without the jet coloring
+   const Detections::Planes &run_planes(Halide::Runtime::Buffer<uint8_t> &input);
+   // Connected regions of the thresholded output, in input pixels
+   const std::vector<Detections::Detection> &detect(Halide::Runtime::Buffer<uint8_t> &input, int min_area = 1);
+   // Same as run(), but only the squares overlapping the regions of interest are computed, with the halo of DRT
+   // lines they read. The output is zero elsewhere
+   Halide::Runtime::Buffer<uint8_t> run_roi(Halide::Runtime::Buffer<uint8_t> &input,
+                                            const std::vector<ROI::Rect> &rois);
+#ifdef WITH_BATCH
+   // Processes a (width, height, frames) stack of images and returns a (squares x, squares y, 3, frames) image
+   Halide::Runtime::Buffer<uint8_t> run_batch(Halide::Runtime::Buffer<uint8_t> &frames);
+#endif
+
+private:
+   void allocate(int width, int height, int frames);
+
+   const OperatingPoint &point;
+   Halide::Runtime::Buffer<int16_t> drt_v;
+   Halide::Runtime::Buffer<int16_t> drt_h;
+   Halide::Runtime::Buffer<int16_t> intensities;
+   Halide::Runtime::Buffer<int16_t> slopes;
+   Halide::Runtime::Buffer<uint8_t> output_image;
+   Detections::Planes planes;
+   Halide::Runtime::Buffer<int16_t> peak;
+   Detections::Extractor extractor;
+   Normalization normalization = Normalization::per_frame;
+   float normalization_value = 0;
+   float average_intensity = 0;
+   int allocated_width = 0;
+   int allocated_height = 0;
+   int allocated_frames = 0;
+};
+
+}
+
+#endif //BARCODE_SEGMENTATION_PARTIAL_DRT_REGISTRY_H
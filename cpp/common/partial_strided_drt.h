@@ -1,11 +1,17 @@
 #ifndef BARCODE_SEGMENTATION_PARTIAL_STRIDED_DRT_H
 #define BARCODE_SEGMENTATION_PARTIAL_STRIDED_DRT_H
 
-#include <HalideRuntime.h>
-#include <HalideBuffer.h>
+#include "partial_drt_registry.h"
 
 namespace PSDRT {
 
+// PartialDRT::Context of the PS DRT, the partial strided DRT at tile size 32 and stride 2
+class Context : public PartialDRT::Context {
+public:
+   Context();
+};
+
+// Runs on a context shared by all callers, not reentrant
 Halide::Runtime::Buffer<uint8_t> run(Halide::Runtime::Buffer<uint8_t> &input);
 
 }
@@ -0,0 +1,16 @@
+#include "preprocess.h"
+#include "preprocess_frame.h"
+#include "instrumentation.h"
+
+namespace Preprocess {
+
+Halide::Runtime::Buffer<uint8_t> &Context::run(const Halide::Runtime::Buffer<uint8_t> &frame, int width, int height) {
+   if (!output.data() || output.width() != width || output.height() != height) {
+      output = Halide::Runtime::Buffer<uint8_t>(width, height, 1);
+      working = output.sliced(2, 0);
+   }
+   INSTRUMENTED(preprocess_frame, preprocess_frame(frame.embedded(2), width, height, output));
+   return working;
+}
+
+}
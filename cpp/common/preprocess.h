@@ -0,0 +1,24 @@
+#ifndef BARCODE_SEGMENTATION_PREPROCESS_H
+#define BARCODE_SEGMENTATION_PREPROCESS_H
+
+#include <HalideBuffer.h>
+
+// Raw camera frames to the working image of the detectors, in one stage: bilinear resample to the working size and
+// min/max contrast stretch. The frame can be any luma view of common/frame_format.h
+namespace Preprocess {
+
+// Owns the working image, reused from frame to frame
+class Context {
+public:
+   // Working image of a width x height luma view, overwritten by the next call
+   Halide::Runtime::Buffer<uint8_t> &run(const Halide::Runtime::Buffer<uint8_t> &frame, int width = 1024,
+                                         int height = 1024);
+
+private:
+   Halide::Runtime::Buffer<uint8_t> output;
+   Halide::Runtime::Buffer<uint8_t> working;
+};
+
+}
+
+#endif //BARCODE_SEGMENTATION_PREPROCESS_H
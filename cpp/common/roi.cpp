@@ -0,0 +1,58 @@
+#include "roi.h"
+
+#include <algorithm>
+
+namespace ROI {
+
+// The region libraries vectorize the line positions by 16
+const int min_lines = 16;
+
+// Floor division, also for negative numerators
+int floor_div(int a, int b) {
+   return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+Range squares(int begin, int end, int tile_size, int stride, int n_squares) {
+   // Square s covers the pixels [s * stride, s * stride + tile_size)
+   Range range{floor_div(begin - tile_size, stride) + 1, floor_div(end - 1, stride) + 1};
+   return {std::max(range.begin, 0), std::min(range.end, n_squares)};
+}
+
+// Line positions read by the bar detector for the squares `range`, with a halo of one tile on each side
+Range lines(const Range &range, int tile_size, int stride, int n) {
+   Range lines{std::max(range.begin * stride - tile_size, 0), std::min(range.end * stride + 2 * tile_size, n)};
+   if (lines.extent() < min_lines) {
+      lines.end = std::min(lines.begin + min_lines, n);
+      lines.begin = std::max(lines.end - min_lines, 0);
+   }
+   return lines;
+}
+
+Crops crops(const Rect &rect, int width, int height, int tile_size, int stride, int n_squares_x, int n_squares_y) {
+   Crops crops;
+   crops.squares_x = squares(rect.x, rect.x + rect.width, tile_size, stride, n_squares_x);
+   crops.squares_y = squares(rect.y, rect.y + rect.height, tile_size, stride, n_squares_y);
+   crops.lines_x = lines(crops.squares_x, tile_size, stride, width);
+   crops.lines_y = lines(crops.squares_y, tile_size, stride, height);
+   return crops;
+}
+
+void zero_outside(Halide::Runtime::Buffer<uint8_t> &image, const std::vector<Rect> &rects, int tile_size,
+                  int stride) {
+   int n_squares_x = image.dim(0).extent(), n_squares_y = image.dim(1).extent();
+   std::vector<uint8_t> inside((size_t) n_squares_x * n_squares_y, 0);
+   for (const Rect &rect: rects) {
+      Range squares_x = squares(rect.x, rect.x + rect.width, tile_size, stride, n_squares_x);
+      Range squares_y = squares(rect.y, rect.y + rect.height, tile_size, stride, n_squares_y);
+      for (int y = squares_y.begin; y < squares_y.end; y++)
+         std::fill(inside.begin() + y * n_squares_x + squares_x.begin,
+                   inside.begin() + y * n_squares_x + std::max(squares_x.end, squares_x.begin), 1);
+   }
+   for (int c = 0; c < image.dim(2).extent(); c++)
+      for (int y = 0; y < n_squares_y; y++)
+         for (int x = 0; x < n_squares_x; x++)
+            if (!inside[y * n_squares_x + x])
+               image(x, y, c) = 0;
+}
+
+}
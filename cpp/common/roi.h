@@ -0,0 +1,43 @@
+#ifndef BARCODE_SEGMENTATION_ROI_H
+#define BARCODE_SEGMENTATION_ROI_H
+
+#include <vector>
+#include <HalideBuffer.h>
+
+namespace ROI {
+
+// Region of interest in input image pixels
+struct Rect {
+   int x, y, width, height;
+};
+
+// Half-open range [begin, end) of squares or line positions
+struct Range {
+   int begin, end;
+
+   bool empty() const { return begin >= end; }
+   int extent() const { return end - begin; }
+};
+
+// Regions of the DRTs and bar detector outputs of a detector with a single square grid that the squares overlapping
+// a rect need. The vertical DRT is cropped to `lines_x` and `squares_y`, the horizontal one to `lines_y` and
+// `squares_x`, and the bar detector outputs to `squares_x` and `squares_y`
+struct Crops {
+   Range squares_x, squares_y;
+   Range lines_x, lines_y;
+
+   bool empty() const { return squares_x.empty() || squares_y.empty(); }
+};
+
+// Squares laid every `stride` pixels, each tile_size pixels wide, that overlap the pixels [begin, end)
+Range squares(int begin, int end, int tile_size, int stride, int n_squares);
+
+Crops crops(const Rect &rect, int width, int height, int tile_size, int stride, int n_squares_x, int n_squares_y);
+
+// Zeroes the squares of an (x, y, channels) image that overlap none of the rects
+void zero_outside(Halide::Runtime::Buffer<uint8_t> &image, const std::vector<Rect> &rects, int tile_size,
+                  int stride);
+
+}
+
+#endif //BARCODE_SEGMENTATION_ROI_H
@@ -0,0 +1,44 @@
+#include "stage_graph.h"
+
+#include <atomic>
+#include <memory>
+
+#include "thread_pool.h"
+
+namespace StageGraph {
+
+int Graph::add(std::function<void()> stage, std::initializer_list<int> dependencies) {
+   int index = (int) nodes.size();
+   nodes.push_back({std::move(stage), {}, (int) dependencies.size()});
+   for (int dependency: dependencies)
+      nodes[dependency].dependents.push_back(index);
+   return index;
+}
+
+void Graph::run() {
+   std::unique_ptr<std::atomic<int>[]> remaining(new std::atomic<int>[nodes.size()]);
+   for (size_t i = 0; i < nodes.size(); i++)
+      remaining[i] = nodes[i].n_dependencies;
+
+   // The stage that completes the last dependency of others starts them as a nested loop, which the pool spreads over
+   // its idle threads. Each loop returns once its stages and those they started are done
+   std::function<void(const std::vector<int> &)> launch = [&](const std::vector<int> &ready) {
+      ThreadPool::parallel_for(0, (int) ready.size(), [&](int i) {
+         const Node &node = nodes[ready[i]];
+         node.stage();
+         std::vector<int> next;
+         for (int dependent: node.dependents)
+            if (--remaining[dependent] == 0)
+               next.push_back(dependent);
+         if (!next.empty())
+            launch(next);
+      });
+   };
+   std::vector<int> roots;
+   for (size_t i = 0; i < nodes.size(); i++)
+      if (nodes[i].n_dependencies == 0)
+         roots.push_back((int) i);
+   launch(roots);
+}
+
+}
@@ -0,0 +1,33 @@
+#ifndef BARCODE_SEGMENTATION_STAGE_GRAPH_H
+#define BARCODE_SEGMENTATION_STAGE_GRAPH_H
+
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+namespace StageGraph {
+
+// Graph of pipeline stages. run() starts each stage as soon as the stages it depends on are done, so independent
+// stages run at the same time, through ThreadPool::parallel_for, on the same threads as the parallel loops of the
+// Halide calls.
+class Graph {
+public:
+   // Adds a stage depending on previously added ones and returns its index
+   int add(std::function<void()> stage, std::initializer_list<int> dependencies = {});
+
+   // Runs every stage once and returns when all of them are done. Not reentrant
+   void run();
+
+private:
+   struct Node {
+      std::function<void()> stage;
+      std::vector<int> dependents;
+      int n_dependencies;
+   };
+
+   std::vector<Node> nodes;
+};
+
+}
+
+#endif //BARCODE_SEGMENTATION_STAGE_GRAPH_H
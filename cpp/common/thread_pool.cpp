@@ -0,0 +1,282 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <HalideRuntime.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ThreadPool {
+
+namespace {
+
+// One parallel loop, on the stack of the thread that called halide_do_par_for
+struct Job {
+   halide_task_t task;
+   void *user_context;
+   uint8_t *closure;
+   std::atomic<int> remaining;
+   // First error returned by a task
+   std::atomic<int> result{0};
+};
+
+struct Range {
+   Job *job;
+   int begin;
+   int end;
+};
+
+// Ranges of one thread: the owner pushes and pops the newest at the back, thieves take the oldest at the front
+struct Deque {
+   std::mutex mutex;
+   std::deque<Range> ranges;
+};
+
+class Pool;
+
+// Pool and deque of the worker threads, the threads outside the pool share the last deque
+thread_local const Pool *worker_pool = nullptr;
+thread_local int worker_slot = 0;
+
+class Pool {
+public:
+   Pool(const Options &options, int n_threads) : n_threads(n_threads) {
+      for (int i = 0; i < n_threads; i++)
+         deques.emplace_back(new Deque());
+      for (int i = 0; i < n_threads - 1; i++) {
+         int cpu = options.cpus.empty() ? -1 : options.cpus[i % options.cpus.size()];
+         int priority = options.priority;
+         workers.emplace_back([this, i, cpu, priority]() { work(i, cpu, priority); });
+      }
+   }
+
+   ~Pool() {
+      {
+         std::lock_guard<std::mutex> lock(sleep_mutex);
+         stopping = true;
+      }
+      wake.notify_all();
+      for (std::thread &worker: workers)
+         worker.join();
+   }
+
+   int par_for(void *user_context, halide_task_t task, int min, int size, uint8_t *closure) {
+      if (size <= 0)
+         return 0;
+      Job job{task, user_context, closure, {size}};
+      int slot = worker_pool == this ? worker_slot : n_threads - 1;
+      execute(slot, {&job, min, min + size});
+      wait(slot, job);
+      return job.result.load();
+   }
+
+   const int n_threads;
+
+private:
+   void work(int slot, int cpu, int priority) {
+#ifdef __linux__
+      if (cpu >= 0) {
+         cpu_set_t set;
+         CPU_ZERO(&set);
+         CPU_SET(cpu, &set);
+         sched_setaffinity(0, sizeof(set), &set);
+      }
+      if (priority != 0)
+         setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), priority);
+#endif
+      worker_pool = this;
+      worker_slot = slot;
+      while (true) {
+         Range range;
+         if (find(slot, range)) {
+            execute(slot, range);
+            continue;
+         }
+         std::unique_lock<std::mutex> lock(sleep_mutex);
+         sleeping++;
+         wake.wait(lock, [this]() { return stopping || pending.load() > 0; });
+         sleeping--;
+         if (stopping && pending.load() == 0)
+            return;
+      }
+   }
+
+   // Runs the first index of the range, after pushing the rest in halves for the other threads
+   void execute(int slot, Range range) {
+      while (range.end - range.begin > 1) {
+         int middle = range.begin + (range.end - range.begin) / 2;
+         push(slot, {range.job, middle, range.end});
+         range.end = middle;
+      }
+      Job *job = range.job;
+      int result = halide_do_task(job->user_context, job->task, range.begin, job->closure);
+      if (result != 0) {
+         int expected = 0;
+         job->result.compare_exchange_strong(expected, result);
+      }
+      // The owner of the job may return as soon as it sees the last index done, the job is not touched after that
+      if (job->remaining.fetch_sub(1) == 1) {
+         std::lock_guard<std::mutex> lock(sleep_mutex);
+         wake.notify_all();
+      }
+   }
+
+   // Helps with any range until the job is done
+   void wait(int slot, Job &job) {
+      while (job.remaining.load() > 0) {
+         Range range;
+         if (find(slot, range)) {
+            execute(slot, range);
+            continue;
+         }
+         std::unique_lock<std::mutex> lock(sleep_mutex);
+         sleeping++;
+         wake.wait(lock, [&]() { return pending.load() > 0 || job.remaining.load() == 0; });
+         sleeping--;
+      }
+   }
+
+   void push(int slot, Range range) {
+      {
+         std::lock_guard<std::mutex> lock(deques[slot]->mutex);
+         deques[slot]->ranges.push_back(range);
+      }
+      pending++;
+      if (sleeping.load() > 0) {
+         std::lock_guard<std::mutex> lock(sleep_mutex);
+         wake.notify_one();
+      }
+   }
+
+   bool find(int slot, Range &range) {
+      if (take(slot, range, false))
+         return true;
+      for (int i = 1; i < n_threads; i++) {
+         if (take((slot + i) % n_threads, range, true))
+            return true;
+      }
+      return false;
+   }
+
+   bool take(int slot, Range &range, bool oldest) {
+      Deque &deque = *deques[slot];
+      std::lock_guard<std::mutex> lock(deque.mutex);
+      if (deque.ranges.empty())
+         return false;
+      if (oldest) {
+         range = deque.ranges.front();
+         deque.ranges.pop_front();
+      } else {
+         range = deque.ranges.back();
+         deque.ranges.pop_back();
+      }
+      pending--;
+      return true;
+   }
+
+   std::vector<std::unique_ptr<Deque>> deques;
+   std::vector<std::thread> workers;
+   // Ranges in the deques, and threads waiting for one
+   std::atomic<int> pending{0};
+   std::atomic<int> sleeping{0};
+   std::mutex sleep_mutex;
+   std::condition_variable wake;
+   bool stopping = false;
+};
+
+std::unique_ptr<Pool> pool;
+halide_do_par_for_t halide_par_for = nullptr;
+halide_do_task_t halide_task = nullptr;
+
+int do_par_for(void *user_context, halide_task_t task, int min, int size, uint8_t *closure) {
+   return pool->par_for(user_context, task, min, size, closure);
+}
+
+int do_task(void *user_context, halide_task_t task, int index, uint8_t *closure) {
+   return task(user_context, index, closure);
+}
+
+int run_body(void *, int index, uint8_t *closure) {
+   (*reinterpret_cast<const std::function<void(int)> *>(closure))(index);
+   return 0;
+}
+
+// Also restores Halide's hooks at exit: being constructed after the pool, it is destroyed before it, so no pipeline
+// started then reaches a destroyed pool
+struct Install {
+   Install() {
+      const char *threads = std::getenv("BARCODE_SEGMENTATION_THREADS");
+      if (threads != nullptr) {
+         Options options;
+         options.n_threads = std::atoi(threads);
+         install(options);
+      }
+   }
+
+   ~Install() {
+      uninstall();
+   }
+} install_from_environment;
+
+}
+
+bool install(const Options &options) {
+   if (options.n_threads < 0)
+      return false;
+   for (int cpu: options.cpus) {
+#ifdef __linux__
+      if (cpu < 0 || cpu >= CPU_SETSIZE)
+         return false;
+#else
+      if (cpu < 0)
+         return false;
+#endif
+   }
+   int n_threads = options.n_threads;
+   if (n_threads == 0)
+      n_threads = std::max(1, (int) std::thread::hardware_concurrency());
+   // The previous pool goes once no loop can reach it anymore
+   pool.reset();
+   pool.reset(new Pool(options, n_threads));
+   if (!halide_par_for) {
+      halide_par_for = halide_set_custom_do_par_for(do_par_for);
+      halide_task = halide_set_custom_do_task(do_task);
+   }
+   return true;
+}
+
+void uninstall() {
+   if (halide_par_for) {
+      halide_set_custom_do_par_for(halide_par_for);
+      halide_set_custom_do_task(halide_task);
+      halide_par_for = nullptr;
+      halide_task = nullptr;
+   }
+   pool.reset();
+}
+
+int n_threads() {
+   return pool ? pool->n_threads : 0;
+}
+
+void parallel_for(int begin, int end, const std::function<void(int)> &body) {
+   if (end <= begin)
+      return;
+   // Goes to the installed pool through the hook
+   halide_do_par_for(nullptr, run_body, begin, end - begin,
+                     reinterpret_cast<uint8_t *>(const_cast<std::function<void(int)> *>(&body)));
+}
+
+}
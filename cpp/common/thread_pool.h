@@ -0,0 +1,42 @@
+#ifndef BARCODE_SEGMENTATION_THREAD_POOL_H
+#define BARCODE_SEGMENTATION_THREAD_POOL_H
+
+#include <functional>
+#include <vector>
+
+// Work-stealing pool for the parallel loops of every pipeline, in place of Halide's own thread pool, which can be
+// neither pinned nor shared with the threads of the application. Once installed, halide_do_par_for splits each loop in
+// halves on the deque of the calling thread: that thread runs the first index and then the newest halves, while idle
+// workers steal the oldest, largest ones. A thread waiting for its loop runs the ranges of other loops meanwhile, so
+// nested loops and pipelines called from several threads at once keep every thread busy.
+namespace ThreadPool {
+
+struct Options {
+   // Threads running the parallel loops, the calling thread included. 0 for one per hardware thread
+   int n_threads = 0;
+   // Worker i is pinned to cpus[i % cpus.size()]. Empty leaves the workers to the OS scheduler. The calling threads
+   // are never pinned
+   std::vector<int> cpus;
+   // Nice value of the workers (Linux and Android), higher running at lower priority. 0 keeps that of the process
+   int priority = 0;
+};
+
+// Routes the parallel loops of every pipeline to a new pool, replacing the previous one. Must not be called while a
+// pipeline runs. Returns false, leaving the current pool in place, when an option is out of range. Also called before
+// main() when the BARCODE_SEGMENTATION_THREADS environment variable holds a thread count
+bool install(const Options &options);
+
+// Back to Halide's thread pool
+void uninstall();
+
+// Threads of the installed pool, the calling thread included. 0 when none is installed
+int n_threads();
+
+// Runs body(i) for i in [begin, end) on the installed pool, or on Halide's thread pool when none is installed, and
+// returns when all are done. The application's own work then shares the cores with the detectors instead of
+// oversubscribing them. Bodies may call parallel_for again
+void parallel_for(int begin, int end, const std::function<void(int)> &body);
+
+}
+
+#endif //BARCODE_SEGMENTATION_THREAD_POOL_H
@@ -10,12 +10,15 @@ public:
    Var x_square{"y_square"};
    Var y_square{"x_square"};
    Var slope{"slope"};
-   Input <Buffer<int16_t>> activations{"activations", 3};
+   Var frame{"frame"};
+   Input <Buffer<int16_t>> activations{"activations", 4};
    Input <Buffer<uint8_t>> jet_r{"jet_lookup_r", 1};
    Input <Buffer<uint8_t>> jet_g{"jet_lookup_g", 1};
    Input <Buffer<uint8_t>> jet_b{"jet_lookup_b", 1};
    Input <float> threshold{"threshold", 8.0f};
-   Output <Buffer<uint8_t>> output{"output", 3};
+   Output <Buffer<uint8_t>> output{"output", 4};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
 
    void generate() {
       using namespace Halide::ConciseCasts;
@@ -23,24 +26,24 @@ public:
 
       // Arg max
       Tuple tupl = argmax(slope_dom, activations(clamp(slope_dom, 0, n_slopes - 1),
-                                                 clamp(x_square, 0, 511),
-                                                 clamp(y_square, 0, 511)));
+                                                 clamp(x_square, 0, activations.dim(1).extent() - 1),
+                                                 clamp(y_square, 0, activations.dim(2).extent() - 1),
+                                                 frame));
       Expr angles = cast<uint8_t>((255 * tupl[0]) / n_slopes);
       Expr intensities;
       intensities = f32(tupl[1]);
-      RDom intensities_dom(0, 512, 0, 512);
       intensities = intensities / threshold;
       // Threshold
       intensities = select(intensities > 1, 1, 0);
 
       // Jet-colorspace
       Var color_channel;
-      output(x_square, y_square, color_channel) = cast<uint8_t>(angles);
-      output(x_square, y_square, color_channel) = u8(select(color_channel == 0,
-                                                         jet_b(angles) * intensities,
-                                                         color_channel == 1,
-                                                         jet_g(angles) * intensities,
-                                                         jet_r(angles) * intensities));
+      output(x_square, y_square, color_channel, frame) = cast<uint8_t>(angles);
+      output(x_square, y_square, color_channel, frame) = u8(select(color_channel == 0,
+                                                                   jet_b(angles) * intensities,
+                                                                   color_channel == 1,
+                                                                   jet_g(angles) * intensities,
+                                                                   jet_r(angles) * intensities));
 //      output(x_square, y_square, color_channel) = cast<uint8_t> (angles * 255);
    }
 
@@ -49,15 +52,17 @@ public:
          activations.dim(0).set_estimate(0, n_slopes);
          activations.dim(1).set_estimate(0, 512);
          activations.dim(2).set_estimate(0, 512);
+         activations.dim(3).set_estimate(0, frames.value());
          jet_r.dim(0).set_estimate(0, 256);
          jet_g.dim(0).set_estimate(0, 256);
          jet_b.dim(0).set_estimate(0, 256);
          output.dim(0).set_estimate(0, 512);
          output.dim(1).set_estimate(0, 512);
          output.dim(2).set_estimate(0, 3);
+         output.dim(3).set_estimate(0, frames.value());
          threshold.set_estimate(0.06f);
       } else {
-         output.compute_root();
+         output.compute_root().parallel(y_square);
       }
    }
 };
@@ -0,0 +1,82 @@
+#include "Halide.h"
+
+namespace {
+
+// Same arg max and threshold as argmaxth, without the jet coloring: the output is an angle index plane, a score plane
+// and a mask packing 8 squares along x per byte
+class ArgmaxthPlanes_generator : public Halide::Generator<ArgmaxthPlanes_generator> {
+private:
+   const int n_slopes = 30;
+   // Score of the threshold in the score plane, Detections::score_scale on the host side
+   const int score_scale = 64;
+
+public:
+   Var x_square{"y_square"};
+   Var y_square{"x_square"};
+   Var x_byte{"x_byte"};
+   Var frame{"frame"};
+   Input <Buffer<int16_t>> activations{"activations", 4};
+   Input <float> threshold{"threshold", 8.0f};
+   Output <Buffer<uint8_t>> angles{"angles", 3};
+   Output <Buffer<uint8_t>> scores{"scores", 3};
+   Output <Buffer<uint8_t>> mask{"mask", 3};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
+   Func argmax_slope{"argmax_slope"};
+   Func above{"above"};
+
+   void generate() {
+      using namespace Halide::ConciseCasts;
+      Expr n_squares_x = activations.dim(1).extent();
+      RDom slope_dom(0, n_slopes);
+
+      // Arg max
+      argmax_slope(x_square, y_square, frame) = argmax(slope_dom,
+                                                       activations(clamp(slope_dom, 0, n_slopes - 1),
+                                                                   clamp(x_square, 0, n_squares_x - 1),
+                                                                   clamp(y_square, 0,
+                                                                         activations.dim(2).extent() - 1),
+                                                                   frame));
+      Expr relative = f32(argmax_slope(x_square, y_square, frame)[1]) / threshold;
+
+      Expr slope_index = argmax_slope(x_square, y_square, frame)[0];
+      angles(x_square, y_square, frame) = cast<uint8_t>((255 * slope_index) / n_slopes);
+      scores(x_square, y_square, frame) = u8_sat(round(relative * score_scale));
+
+      // Threshold, packed
+      above(x_square, y_square, frame) = u8(select(relative > 1, 1, 0));
+      RDom bit(0, 8);
+      Expr x = x_byte * 8 + bit;
+      mask(x_byte, y_square, frame) = sum(select(x < n_squares_x,
+                                                 above(min(x, n_squares_x - 1), y_square, frame) << u8(bit),
+                                                 u8(0)));
+   }
+
+   void schedule() {
+      if (using_autoscheduler()) {
+         activations.dim(0).set_estimate(0, n_slopes);
+         activations.dim(1).set_estimate(0, 512);
+         activations.dim(2).set_estimate(0, 512);
+         activations.dim(3).set_estimate(0, frames.value());
+         angles.dim(0).set_estimate(0, 512);
+         angles.dim(1).set_estimate(0, 512);
+         angles.dim(2).set_estimate(0, frames.value());
+         scores.dim(0).set_estimate(0, 512);
+         scores.dim(1).set_estimate(0, 512);
+         scores.dim(2).set_estimate(0, frames.value());
+         mask.dim(0).set_estimate(0, 512 / 8);
+         mask.dim(1).set_estimate(0, 512);
+         mask.dim(2).set_estimate(0, frames.value());
+         threshold.set_estimate(0.06f);
+      } else {
+         argmax_slope.compute_root().parallel(y_square);
+         angles.compute_root().parallel(y_square).vectorize(x_square, 16, Halide::TailStrategy::GuardWithIf);
+         scores.compute_root().parallel(y_square).vectorize(x_square, 16, Halide::TailStrategy::GuardWithIf);
+         mask.compute_root().parallel(y_square);
+      }
+   }
+};
+
+} // namespace
+
+HALIDE_REGISTER_GENERATOR(ArgmaxthPlanes_generator, argmaxth_planes)
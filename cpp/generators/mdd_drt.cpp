@@ -5,37 +5,47 @@ private:
    Var i, j;
    const int32_t STRIDE = 32;
    const int32_t TILE_SIZE = 32;
+   // Nominal input side used by the schedules, the algorithm reads the extents of `in`
    const int32_t VAL_N = 1024;
    const int32_t stride_bits = std::log2(STRIDE);
    const int32_t tile_size_bits = std::log2(TILE_SIZE);
-   Var x{"ySquareMp1"}, y{"_slope"}, c{"writeIdx"};
+   Var x{"ySquareMp1"}, y{"_slope"}, c{"writeIdx"}, frame{"frame"};
+   Halide::Func in_rows{"in_rows"};
    Halide::Func fm[6];
 
 public:
-   Input <Buffer<uint8_t>> in{"in", 2};
-   Output <Buffer<int16_t>> fm_1{"out_1", 3};
-   Output <Buffer<int16_t>> fm_2{"out_2", 3};
-   Output <Buffer<int16_t>> fm_3{"out_3", 3};
-   Output <Buffer<int16_t>> fm_4{"out_4", 3};
-   Output <Buffer<int16_t>> fm_5{"out_5", 3};
+   Input <Buffer<uint8_t>> in{"in", 3};
+   Output <Buffer<int16_t>> fm_1{"out_1", 4};
+   Output <Buffer<int16_t>> fm_2{"out_2", 4};
+   Output <Buffer<int16_t>> fm_3{"out_3", 4};
+   Output <Buffer<int16_t>> fm_4{"out_4", 4};
+   Output <Buffer<int16_t>> fm_5{"out_5", 4};
    GeneratorParam<bool> transpose{"transpose", false};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
 
    void generate() {
       Var ySquareMp1 = x;
       Var _slope = y;
       Var writeIdx = c;
       Var readIdx = c;
+      // The luma samples may be interleaved with chroma (YUYV), see common/frame_format.h
+      in.dim(0).set_stride(Expr());
+      // Length of the projected lines and number of lines, taken from the input at runtime
+      Expr n_write = transpose.value() ? in.dim(1).extent() : in.dim(0).extent();
+      Expr n_lines = transpose.value() ? in.dim(0).extent() : in.dim(1).extent();
       if (transpose) {
-         fm[0](writeIdx, _slope, ySquareMp1) = cast<int16_t>(
-            in(clamp(ySquareMp1, 0, VAL_N - 1), clamp(writeIdx, 0, VAL_N - 1)));
+         // The columns of the input are the lines: a transposed copy lets the stages read them as rows
+         in_rows(i, j, frame) = in(clamp(j, 0, n_lines - 1), clamp(i, 0, n_write - 1), frame);
+         fm[0](writeIdx, _slope, ySquareMp1, frame) = cast<int16_t>(in_rows(writeIdx, ySquareMp1, frame));
       } else {
-         fm[0](writeIdx, _slope, ySquareMp1) = cast<int16_t>(
-            in(clamp(writeIdx, 0, VAL_N - 1), clamp(ySquareMp1, 0, VAL_N - 1)));
+         fm[0](writeIdx, _slope, ySquareMp1, frame) = cast<int16_t>(
+            in(clamp(writeIdx, 0, n_write - 1), clamp(ySquareMp1, 0, n_lines - 1), frame));
       }
       for (int32_t m = 0; m < tile_size_bits; m++) {
          int32_t M = 1 << m;
          int32_t Mp1 = 1 << (m + 1);
-         int32_t nSquaresMp1 = ((VAL_N - std::min(Mp1, TILE_SIZE)) / std::min(Mp1, STRIDE)) + 1;
+         Expr nSquaresMp1 = ((n_lines - std::min(Mp1, TILE_SIZE)) / std::min(Mp1, STRIDE)) + 1;
          int32_t in_slope_size = 2 * M - 1;
          Expr slope = _slope - Mp1 + 1;
          Expr abs_s = abs(slope);
@@ -44,28 +54,32 @@ public:
          Expr s_sign = select(slope < 0, -1, 1);
          Expr slopeM = M - 1 + s2 * s_sign;
          Expr incIndB = s_sign * (s2 + rs);
-         Expr A = select((readIdx >= VAL_N) || (readIdx < 0),
+         Expr A = select((readIdx >= n_write) || (readIdx < 0),
                          0,
                          m < stride_bits,
-                         fm[m](clamp(readIdx, 0, VAL_N - 1),
+                         fm[m](clamp(readIdx, 0, n_write - 1),
                                clamp(slopeM, 0, in_slope_size - 1),
-                               clamp(ySquareMp1 << 1, 0, nSquaresMp1 * 2 - 2)),
-                         fm[m](clamp(readIdx, 0, VAL_N - 1),
+                               clamp(ySquareMp1 << 1, 0, nSquaresMp1 * 2 - 2),
+                               frame),
+                         fm[m](clamp(readIdx, 0, n_write - 1),
                                clamp(slopeM, 0, in_slope_size - 1),
-                               clamp(ySquareMp1, 0, nSquaresMp1 - 1)
+                               clamp(ySquareMp1, 0, nSquaresMp1 - 1),
+                               frame
                          ));
 
-         Expr B = select((readIdx + incIndB < 0) || (readIdx + incIndB >= VAL_N),
+         Expr B = select((readIdx + incIndB < 0) || (readIdx + incIndB >= n_write),
                          0,
                          m < stride_bits,
-                         fm[m](clamp(readIdx + incIndB, 0, VAL_N - 1),
+                         fm[m](clamp(readIdx + incIndB, 0, n_write - 1),
                                clamp(slopeM, 0, in_slope_size - 1),
-                               clamp((ySquareMp1 << 1) + 1, 0, (nSquaresMp1 << 1) - 1)),
-                         fm[m](clamp(readIdx + incIndB, 0, VAL_N - 1),
+                               clamp((ySquareMp1 << 1) + 1, 0, (nSquaresMp1 << 1) - 1),
+                               frame),
+                         fm[m](clamp(readIdx + incIndB, 0, n_write - 1),
                                clamp(slopeM, 0, in_slope_size - 1),
-                               clamp(ySquareMp1 + m - stride_bits + 1, 0, nSquaresMp1 + m - stride_bits)
+                               clamp(ySquareMp1 + m - stride_bits + 1, 0, nSquaresMp1 + m - stride_bits),
+                               frame
                          ));
-         fm[m + 1](writeIdx, _slope, ySquareMp1) = A + B;
+         fm[m + 1](writeIdx, _slope, ySquareMp1, frame) = A + B;
       }
       fm_1 = fm[1];
       fm_2 = fm[2];
@@ -78,21 +92,27 @@ public:
       if (using_autoscheduler()) {
          in.dim(0).set_estimate(0, VAL_N);
          in.dim(1).set_estimate(0, VAL_N);
+         in.dim(2).set_estimate(0, frames.value());
          fm_1.set_estimate(x, 0, 512)
             .set_estimate(y, 0, 3)
-            .set_estimate(c, 0, 1024);
+            .set_estimate(c, 0, 1024)
+            .set_estimate(frame, 0, frames.value());
          fm_2.set_estimate(x, 0, 256)
             .set_estimate(y, 0, 7)
-            .set_estimate(c, 0, 1024);
+            .set_estimate(c, 0, 1024)
+            .set_estimate(frame, 0, frames.value());
          fm_3.set_estimate(x, 0, 128)
             .set_estimate(y, 0, 15)
-            .set_estimate(c, 0, 1024);
+            .set_estimate(c, 0, 1024)
+            .set_estimate(frame, 0, frames.value());
          fm_4.set_estimate(x, 0, 64)
             .set_estimate(y, 0, 31)
-            .set_estimate(c, 0, 1024);
+            .set_estimate(c, 0, 1024)
+            .set_estimate(frame, 0, frames.value());
          fm_5.set_estimate(x, 0, 32)
             .set_estimate(y, 0, 63)
-            .set_estimate(c, 0, 1024);
+            .set_estimate(c, 0, 1024)
+            .set_estimate(frame, 0, frames.value());
       } else if (get_target().has_feature(Halide::Target::OpenCL)) {
          std::cout << "Scheduling for opencl " << std::endl;
          using ::Halide::Func;
@@ -100,12 +120,13 @@ public:
          using ::Halide::RVar;
          using Halide::TailStrategy;
          using ::Halide::Var;
-         auto f0 = get_pipeline().get_func(1);
-         auto f1 = get_pipeline().get_func(2);
-         auto f2 = get_pipeline().get_func(3);
-         auto f3 = get_pipeline().get_func(4);
-         auto f4 = get_pipeline().get_func(5);
-         auto f5 = get_pipeline().get_func(6);
+         // By name rather than by index in get_pipeline(), which in_rows shifts for the transposed DRT
+         Func f0 = fm[0];
+         Func f1 = fm_1;
+         Func f2 = fm_2;
+         Func f3 = fm_3;
+         Func f4 = fm_4;
+         Func f5 = fm_5;
 
          Var fused1("fused_var1");
          Var fused2("fused_var2");
@@ -137,13 +158,40 @@ public:
          f4.gpu_blocks(x).gpu_threads(c);
          f5.gpu_blocks(x).gpu_threads(c);
       } else {
-         fm_1.compute_root();
-         fm_2.compute_root();
-         fm_3.compute_root();
-         fm_4.compute_root();
-         fm_5.compute_root();
+         // Used by the *_region libraries, which compute cropped outputs: the squares are not split, and the crops
+         // span at least 16 line positions
+         if (transpose)
+            schedule_in_rows();
+         // Unlike the partial DRT, every stage is an output, read whole by the bar detector of its stage, so none
+         // can be computed per square of the next one and kept in folded storage
+         fm_1.compute_root().parallel(x).vectorize(c, 16);
+         fm_2.compute_root().parallel(x).vectorize(c, 16);
+         fm_3.compute_root().parallel(x).vectorize(c, 16);
+         fm_4.compute_root().parallel(x).vectorize(c, 16);
+         fm_5.compute_root().parallel(x).vectorize(c, 16);
+         // Vector loads of dense luma, the same stage reads interleaved luma with its stride
+         if (!transpose)
+            fm_1.specialize(in.dim(0).stride() == 1);
       }
    } // schedule
+
+private:
+   // Blocked transpose of the manual schedule: each 16x16 block of the input is loaded with 16 row vectors, and the
+   // unrolled transposed copy reads it back from registers, so that no stage reads the input a column at a time.
+   // Autoscheduled builds leave in_rows to the autoscheduler
+   void schedule_in_rows() {
+      Var io{"io"}, jo{"jo"}, ii{"ii"}, ji{"ji"};
+      Halide::Func block = in.in(in_rows);
+      in_rows.compute_root()
+         .tile(i, j, io, jo, ii, ji, 16, 16, Halide::TailStrategy::GuardWithIf)
+         .vectorize(ii)
+         .unroll(ji)
+         .parallel(jo);
+      block.compute_at(in_rows, io)
+         .vectorize(block.args()[0], 16, Halide::TailStrategy::GuardWithIf)
+         .unroll(block.args()[1]);
+      block.specialize(in.dim(0).stride() == 1);
+   }
 };
 
 HALIDE_REGISTER_GENERATOR(MDDDRTGenerator, mdd_drt)
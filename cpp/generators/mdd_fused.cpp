@@ -0,0 +1,326 @@
+#include "Halide.h"
+
+namespace {
+
+// The whole MDD DRT as a single pipeline: the stages of mdd_drt, mdd_bar_detector, unpool, convolutions and argmaxth
+// are defined over Funcs instead of buffers, so the schedule can fuse them instead of writing every stage to memory.
+class MDDFused_generator : public Halide::Generator<MDDFused_generator> {
+private:
+   // Nominal input side for the schedule estimates
+   const int VAL_N = 1024;
+   const int N_STAGES = 5;
+   // Unpool is called for stages 1 to 4
+   const int16_t coarse_slope_size[5] = {126, 62, 30, 30, 30};
+   const int16_t fine_slope_size[5] = {-1, 62, 30, 14, 6};
+   const int n_slopes_output = 30;
+   // Side of the output tiles the encoder and decoder stages are computed in
+   const int TILE = 64;
+
+   // DRT pyramids, computed once per frame
+   std::vector<Func> drt_funcs;
+   // First DRT stages, the ones reading the input
+   std::vector<Func> input_stages;
+   // Everything after the DRT, computed per output tile
+   std::vector<Func> tile_funcs;
+
+public:
+   Var c{"writeIdx"}, y{"_slope"}, x{"ySquareMp1"};
+   Var x_square{"x_square"};
+   Var y_square{"y_square"};
+   Var slope{"slope"};
+   Var frame{"frame"};
+   Var color_channel{"color_channel"};
+   Input <Buffer<uint8_t>> in{"in", 3};
+   Input <Buffer<uint8_t>> jet_r{"jet_lookup_r", 1};
+   Input <Buffer<uint8_t>> jet_g{"jet_lookup_g", 1};
+   Input <Buffer<uint8_t>> jet_b{"jet_lookup_b", 1};
+   Input<float> w_orig_3{"w_orig_3", 1.0f};
+   Input<float> w_orig_2{"w_orig_2", 1.0f};
+   Input<float> w_orig_1{"w_orig_1", 1.0f};
+   Input<float> w_orig_0{"w_orig_0", 1.0f};
+   Input<float> w_new_3{"w_new_3", 1.0f};
+   Input<float> w_new_2{"w_new_2", 1.0f};
+   Input<float> w_new_1{"w_new_1", 1.0f};
+   Input<float> w_new_0{"w_new_0", 1.0f};
+   Input<float> threshold{"threshold", 0.05f};
+   Output <Buffer<uint8_t>> output{"output", 4};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
+
+   // Number of squares of the given stage along a side of n pixels
+   static Expr n_squares(Expr n, int stage) {
+      return (n - (1 << stage)) / (1 << stage) + 1;
+   }
+
+   // Stages 0 to 5 of the partial DRT (tile size and stride of 32), as in mdd_drt
+   std::vector<Func> drt(bool transpose, Expr n_write, Expr n_lines) {
+      using namespace Halide::ConciseCasts;
+      const char *direction = transpose ? "h" : "v";
+      Var ySquareMp1 = x;
+      Var _slope = y;
+      Var writeIdx = c;
+      Var readIdx = c;
+      std::vector<Func> fm;
+      for (int m = 0; m <= N_STAGES; m++)
+         fm.emplace_back("drt_" + std::string(direction) + "_" + std::to_string(m));
+      if (transpose) {
+         fm[0](writeIdx, _slope, ySquareMp1, frame) = cast<int16_t>(
+            in(clamp(ySquareMp1, 0, n_lines - 1), clamp(writeIdx, 0, n_write - 1), frame));
+      } else {
+         fm[0](writeIdx, _slope, ySquareMp1, frame) = cast<int16_t>(
+            in(clamp(writeIdx, 0, n_write - 1), clamp(ySquareMp1, 0, n_lines - 1), frame));
+      }
+      for (int32_t m = 0; m < N_STAGES; m++) {
+         int32_t M = 1 << m;
+         int32_t Mp1 = 1 << (m + 1);
+         Expr nSquaresMp1 = n_squares(n_lines, m + 1);
+         int32_t in_slope_size = 2 * M - 1;
+         Expr slope_m = _slope - Mp1 + 1;
+         Expr abs_s = abs(slope_m);
+         Expr s2 = abs_s >> 1; // floor (half of the absolute slope)
+         Expr rs = abs_s - 2 * s2; // Remainder of the absolute slope
+         Expr s_sign = select(slope_m < 0, -1, 1);
+         Expr slopeM = M - 1 + s2 * s_sign;
+         Expr incIndB = s_sign * (s2 + rs);
+         Expr A = select((readIdx >= n_write) || (readIdx < 0),
+                         0,
+                         fm[m](clamp(readIdx, 0, n_write - 1),
+                               clamp(slopeM, 0, in_slope_size - 1),
+                               clamp(ySquareMp1 << 1, 0, nSquaresMp1 * 2 - 2),
+                               frame));
+         Expr B = select((readIdx + incIndB < 0) || (readIdx + incIndB >= n_write),
+                         0,
+                         fm[m](clamp(readIdx + incIndB, 0, n_write - 1),
+                               clamp(slopeM, 0, in_slope_size - 1),
+                               clamp((ySquareMp1 << 1) + 1, 0, (nSquaresMp1 << 1) - 1),
+                               frame));
+         fm[m + 1](writeIdx, _slope, ySquareMp1, frame) = A + B;
+         drt_funcs.push_back(fm[m + 1]);
+         if (m == 0)
+            input_stages.push_back(fm[1]);
+      }
+      return fm;
+   }
+
+   // Encoder of one stage, as in mdd_bar_detector
+   Func bar_detector(int stage, Func drt_h, Func drt_v, Expr n_write_h, Expr n_write_v,
+                     Expr n_squares_x, Expr n_squares_y) {
+      using namespace Halide::ConciseCasts;
+      int tile_size = (2 << (stage - 1));
+      int stride = (2 << (stage - 1));
+      int n_slopes = 2 * tile_size - 1;
+      Expr y_central = y_square * stride + tile_size / 2;
+      Expr x_central = x_square * stride + tile_size / 2;
+      Expr signed_slope = slope - tile_size + 1;
+      RDom dom(-(tile_size >> 1), ((tile_size >> 1) << 1) - 1);
+      Expr disp_h = y_central + dom - signed_slope / 2;
+      Expr disp_v = x_central + dom + signed_slope / 2;
+      // The stage generators read the DRTs from buffers with repeat_edge, these are the same bounds
+      Func clamped_drt_h = Halide::BoundaryConditions::repeat_edge(
+         drt_h, {{0, n_write_h}, {0, n_slopes}, {0, n_squares_x}, {Expr(), Expr()}});
+      Func clamped_drt_v = Halide::BoundaryConditions::repeat_edge(
+         drt_v, {{0, n_write_v}, {0, n_slopes}, {0, n_squares_y}, {Expr(), Expr()}});
+      Var dx, dy, dz;
+      Func diff_h, diff_v;
+      diff_h(dx, dy, dz, frame) = abs(clamped_drt_h(dx + 1, dy, dz, frame) - clamped_drt_h(dx, dy, dz, frame));
+      diff_v(dx, dy, dz, frame) = abs(clamped_drt_v(dx + 1, dy, dz, frame) - clamped_drt_v(dx, dy, dz, frame));
+      Expr std_h = sum(dom, diff_h(disp_h, signed_slope + tile_size - 1, x_square, frame));
+      Expr std_v = sum(dom, diff_v(disp_v, - signed_slope + tile_size - 1, y_square, frame));
+      Func V{"V_" + std::to_string(stage)};
+      V(slope, x_square, y_square, frame) = i16(std_h) - i16(std_v);
+      Expr clamped_x = clamp(x_square, 0, n_squares_x - 1);
+      Expr clamped_y = clamp(y_square, 0, n_squares_y - 1);
+      Expr border = x_square == 0 || y_square == 0 || x_square == n_squares_x - 1 || y_square == n_squares_y - 1;
+      Func encoder{"encoder_" + std::to_string(stage)};
+      encoder(slope, x_square, y_square, frame) = select(border,
+                                                         i16(0),
+                                                         slope < n_slopes,
+                                                         V(clamp(slope, 0, n_slopes - 1), clamped_x, clamped_y, frame),
+                                                         -V(clamp(slope - n_slopes, 0, n_slopes - 1), clamped_x,
+                                                            clamped_y, frame));
+      tile_funcs.push_back(encoder);
+      return encoder;
+   }
+
+   // Unpooling of the coarse activations onto the fine ones, as in unpool
+   Func unpool(int stage, Func coarse_activations, Func fine_activations, Expr n_squares_coarse_x,
+               Expr n_squares_coarse_y, Expr n_squares_fine_x, Expr n_squares_fine_y, Expr weight_new,
+               Expr weight_original) {
+      using namespace Halide::ConciseCasts;
+      int16_t n_slopes_fine = fine_slope_size[stage];
+      int16_t n_slopes_coarse = coarse_slope_size[stage - 1];
+      int16_t n_slopes_unpooled = coarse_slope_size[stage];
+      int slope_ratio = n_slopes_coarse / n_slopes_fine;
+      float new_activations_slope_ratio = (float) n_slopes_coarse / (float) n_slopes_unpooled;
+      // Arg max over the coarse slopes and over the 2x2 fine squares, which do not depend on the output slope
+      std::string suffix = "_" + std::to_string(stage);
+      Func coarse_max{"coarse_max" + suffix}, fine_max{"fine_max" + suffix};
+      RDom slope_dom(0, n_slopes_coarse);
+      coarse_max(x_square, y_square, frame) = argmax(
+         slope_dom, coarse_activations(clamp(slope_dom, 0, n_slopes_coarse - 1),
+                                       clamp(i32(x_square) / 2, 0, n_squares_coarse_x - 1),
+                                       clamp(i32(y_square) / 2, 0, n_squares_coarse_y - 1),
+                                       frame));
+      Expr max_slope_indices = coarse_max(x_square, y_square, frame)[0];
+      Expr values = coarse_max(x_square, y_square, frame)[1];
+      Expr fine_activations_coarser_slope = (cast<int>(max_slope_indices) / slope_ratio) % n_slopes_fine;
+      RDom ij(0, 2, 0, 2);
+      Expr x_square_rounded = u16(x_square * 0.5f) * 2;
+      Expr y_square_rounded = u16(y_square * 0.5f) * 2;
+      fine_max(x_square, y_square, frame) = argmax(
+         ij, fine_activations(
+            clamp(fine_activations_coarser_slope, 0, n_slopes_fine - 1),
+            clamp(i32(x_square_rounded + ij.x), 0, n_squares_fine_x - 1),
+            clamp(i32(y_square_rounded + ij.y), 0, n_squares_fine_y - 1),
+            frame));
+      Expr jj = fine_max(x_square, y_square, frame)[0];
+      Expr ii = fine_max(x_square, y_square, frame)[1];
+      Expr output_slope = round(max_slope_indices / new_activations_slope_ratio) % n_slopes_unpooled;
+      Expr new_activations = select((slope == output_slope) &&
+                                    (x_square == (x_square_rounded + jj)) &&
+                                    (y_square == (y_square_rounded + ii)),
+                                    values,
+                                    0);
+      // add_original_activations
+      int add_slope_ratio = n_slopes_unpooled / n_slopes_fine;
+      Func new_fine_activations{"unpool" + suffix};
+      new_fine_activations(slope, x_square, y_square, frame) = i16(
+         new_activations * weight_new +
+         fine_activations(clamp((i32(slope) / i32(add_slope_ratio)) % i32(n_slopes_fine), 0, n_slopes_fine),
+                          x_square, y_square, frame) * weight_original);
+      tile_funcs.insert(tile_funcs.end(), {coarse_max, fine_max, new_fine_activations});
+      return new_fine_activations;
+   }
+
+   // Spatial and angular smoothing, as in convolutions
+   Func convolutions(int stage, Func activations, int n_slopes, Expr n_squares_x, Expr n_squares_y) {
+      std::string suffix = "_" + std::to_string(stage);
+      Func clamped = Halide::BoundaryConditions::mirror_image(
+         activations, {{0, n_slopes}, {0, n_squares_x}, {0, n_squares_y}, {Expr(), Expr()}});
+      Func filter_v{"filter_v" + suffix}, filter_vh{"filter_vh" + suffix};
+      Func filter_v2{"filter_v2" + suffix}, filter_vh2{"filter_vh2" + suffix};
+      Func filter_vhd{"filter_vhd" + suffix};
+
+      filter_v(slope, x_square, y_square, frame) =
+              clamped(slope, x_square, y_square - 1, frame) / 3 +
+              clamped(slope, x_square, y_square, frame) / 3 +
+              clamped(slope, x_square, y_square + 1, frame) / 3;
+
+      filter_vh(slope, x_square, y_square, frame) =
+              filter_v(slope, x_square - 1, y_square, frame) / 3 +
+              filter_v(slope, x_square, y_square, frame) / 3 +
+              filter_v(slope, x_square + 1, y_square, frame) / 3;
+
+      filter_v2(slope, x_square, y_square, frame) =
+         filter_vh(slope, x_square, y_square - 1, frame) / 3 +
+         filter_vh(slope, x_square, y_square, frame) / 3 +
+         filter_vh(slope, x_square, y_square + 1, frame) / 3;
+
+      filter_vh2(slope, x_square, y_square, frame) =
+         filter_v2(slope, x_square - 1, y_square, frame) / 3 +
+         filter_v2(slope, x_square, y_square, frame) / 3 +
+         filter_v2(slope, x_square + 1, y_square, frame) / 3;
+
+      filter_vhd(slope, x_square, y_square, frame) =
+        (filter_vh2((slope - 1) % n_slopes, x_square, y_square, frame)) / 4 +
+        (filter_vh2(slope, x_square, y_square, frame)) / 2 +
+        (filter_vh2((slope + 1) % n_slopes, x_square, y_square, frame)) / 4;
+      tile_funcs.insert(tile_funcs.end(), {filter_v, filter_vh, filter_v2, filter_vh2, filter_vhd});
+      return filter_vhd;
+   }
+
+   void generate() {
+      using namespace Halide::ConciseCasts;
+      // The luma samples may be interleaved with chroma (YUYV), see common/frame_format.h
+      in.dim(0).set_stride(Expr());
+      Expr width = in.dim(0).extent();
+      Expr height = in.dim(1).extent();
+      std::vector<Func> drt_v = drt(false, width, height);
+      std::vector<Func> drt_h = drt(true, height, width);
+
+      Func encoder[6];
+      for (int stage = 1; stage <= N_STAGES; stage++)
+         encoder[stage] = bar_detector(stage, drt_h[stage], drt_v[stage], height, width,
+                                       n_squares(width, stage), n_squares(height, stage));
+
+      // Decoder, from the coarsest stage to the finest one. Unpool stage s refines onto encoder 5 - s
+      Expr w_new[4] = {w_new_0, w_new_1, w_new_2, w_new_3};
+      Expr w_orig[4] = {w_orig_0, w_orig_1, w_orig_2, w_orig_3};
+      Func activations = encoder[N_STAGES];
+      for (int stage = 1; stage < N_STAGES; stage++) {
+         int fine = N_STAGES - stage;
+         Func unpooled = unpool(stage, activations, encoder[fine],
+                                n_squares(width, fine + 1), n_squares(height, fine + 1),
+                                n_squares(width, fine), n_squares(height, fine),
+                                w_new[fine - 1], w_orig[fine - 1]);
+         activations = convolutions(fine, unpooled, coarse_slope_size[stage],
+                                    n_squares(width, fine), n_squares(height, fine));
+      }
+
+      // Arg max, threshold and jet-colorspace, as in argmaxth
+      RDom slope_dom(0, n_slopes_output);
+      Tuple tupl = argmax(slope_dom, activations(clamp(slope_dom, 0, n_slopes_output - 1),
+                                                 clamp(x_square, 0, n_squares(width, 1) - 1),
+                                                 clamp(y_square, 0, n_squares(height, 1) - 1),
+                                                 frame));
+      Expr angles = cast<uint8_t>((255 * tupl[0]) / n_slopes_output);
+      Expr intensities = f32(tupl[1]) / threshold;
+      intensities = select(intensities > 1, 1, 0);
+      output(x_square, y_square, color_channel, frame) = u8(select(color_channel == 0,
+                                                                   jet_b(angles) * intensities,
+                                                                   color_channel == 1,
+                                                                   jet_g(angles) * intensities,
+                                                                   jet_r(angles) * intensities));
+   }
+
+   void schedule() {
+      if (using_autoscheduler()) {
+         in.dim(0).set_estimate(0, VAL_N);
+         in.dim(1).set_estimate(0, VAL_N);
+         in.dim(2).set_estimate(0, frames.value());
+         jet_r.dim(0).set_estimate(0, 256);
+         jet_g.dim(0).set_estimate(0, 256);
+         jet_b.dim(0).set_estimate(0, 256);
+         w_orig_3.set_estimate(1.0f);
+         w_orig_2.set_estimate(1.0f);
+         w_orig_1.set_estimate(1.0f);
+         w_orig_0.set_estimate(1.0f);
+         w_new_3.set_estimate(1.0f);
+         w_new_2.set_estimate(1.0f);
+         w_new_1.set_estimate(1.0f);
+         w_new_0.set_estimate(1.0f);
+         threshold.set_estimate(0.06f);
+         output.dim(0).set_estimate(0, VAL_N / 2);
+         output.dim(1).set_estimate(0, VAL_N / 2);
+         output.dim(2).set_estimate(0, 3);
+         output.dim(3).set_estimate(0, frames.value());
+      } else {
+         // Only the DRT pyramids go through memory. The encoders and the whole decoder are computed per output
+         // tile, with the halos the unpool and convolution stages need, so they stay in cache. The arg maxes of
+         // unpool are among them, so they are computed once per square of the tile rather than once per slope.
+         Var xo{"xo"}, yo{"yo"}, xi{"xi"}, yi{"yi"};
+         for (Func &f: drt_funcs) {
+            f.compute_root()
+               .parallel(x)
+               .vectorize(c, 16);
+         }
+         // Vector loads of dense luma, the same stages read interleaved luma with its stride
+         for (Func &f: input_stages)
+            f.specialize(in.dim(0).stride() == 1);
+         // The output size follows the input, so small inputs give fewer squares than a tile
+         output.compute_root()
+            .bound(color_channel, 0, 3)
+            .tile(x_square, y_square, xo, yo, xi, yi, TILE, TILE, TailStrategy::GuardWithIf)
+            .reorder(xi, color_channel, yi, xo, yo, frame)
+            .unroll(color_channel)
+            .vectorize(xi, 16)
+            .parallel(yo);
+         for (Func &f: tile_funcs)
+            f.compute_at(output, xo);
+      }
+   }
+};
+
+} // namespace
+
+HALIDE_REGISTER_GENERATOR(MDDFused_generator, mdd_fused)
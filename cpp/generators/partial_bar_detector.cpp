@@ -0,0 +1,125 @@
+#include "Halide.h"
+#include <math.h>
+
+namespace {
+
+// Bar detector of a partial strided DRT, see partial_drt.cpp: reads the last stage of the horizontal and vertical
+// DRTs and outputs the intensity and slope of the strongest bar pattern of each square
+class PartialBarDetector_generator : public Halide::Generator<PartialBarDetector_generator> {
+private:
+   const int VAL_N = 1024;
+
+public:
+   Var x_square{"y_square"};
+   Var y_square{"x_square"};
+   Var slope{"slope"};
+   Var frame{"frame"};
+   Var dx{"dx"}, dy{"dy"}, dz{"dz"};
+   Input <Buffer<int16_t>> pidrt_h{"pidrt_h", 4};
+   Input <Buffer<int16_t>> pidrt_v{"pidrt_v", 4};
+   Output <Buffer<int16_t>> intensities{"intensities", 3};
+   Output <Buffer<int16_t>> slopes{"slopes", 3};
+   // Operating point of the DRTs, both powers of two with stride <= tile_size
+   GeneratorParam<int32_t> tile_size{"tile_size", 32};
+   GeneratorParam<int32_t> stride{"stride", 2};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
+   Func is_horizontal;
+   // Differences of neighbouring DRT lines, and their sums per slope
+   Func diff_h{"diff_h"};
+   Func diff_v{"diff_v"};
+   Func V{"V"};
+   Func best{"best"};
+
+   // Slopes of the last DRT stage
+   int n_slopes() const {
+      return 2 * tile_size.value() - 1;
+   }
+
+   // Nominal square count for the schedule estimates
+   int n_squares() const {
+      return (VAL_N - tile_size.value()) / stride.value() + 1;
+   }
+
+   void generate() {
+      using namespace Halide::ConciseCasts;
+      // Square counts along each axis, given by the DRTs of the actual input
+      Expr n_squares_x = pidrt_h.dim(2).extent();
+      Expr n_squares_y = pidrt_v.dim(2).extent();
+      Expr y_central = y_square * stride.value() + tile_size.value() / 2;
+      Expr x_central = x_square * stride.value() + tile_size.value() / 2;
+      Expr signed_slope = i32(slope) - tile_size.value() + 1;
+      RDom displ_dom(-(tile_size.value() >> 1), ((tile_size.value() >> 1) << 1) - 1);
+      Expr disp_h = y_central + displ_dom - signed_slope / 2;
+      Expr disp_v = x_central + displ_dom + signed_slope / 2;
+      Func clamped_pidrt_h = Halide::BoundaryConditions::repeat_edge(pidrt_h);
+      Func clamped_pidrt_v = Halide::BoundaryConditions::repeat_edge(pidrt_v);
+      auto difference = [&](Func drt, Expr x, Expr y, Expr z) {
+         return abs(drt(x + 1, y, z, frame) - drt(x, y, z, frame));
+      };
+      Expr slope_h = signed_slope + tile_size.value() - 1;
+      Expr slope_v = -signed_slope + tile_size.value() - 1;
+      diff_h(dx, dy, dz, frame) = difference(clamped_pidrt_h, dx, dy, dz);
+      diff_v(dx, dy, dz, frame) = difference(clamped_pidrt_v, dx, dy, dz);
+      Expr std_h = sum(displ_dom, diff_h(disp_h, slope_h, x_square, frame));
+      Expr std_v = sum(displ_dom, diff_v(disp_v, slope_v, y_square, frame));
+      V(slope, x_square, y_square, frame) = abs(i16(std_h) - i16(std_v));
+      // Only read at the best slope of each square. Its sums read the DRTs rather than diff_h and diff_v, so that a
+      // manual schedule can compute those where V is
+      is_horizontal(slope, x_square, y_square, frame) =
+              sum(displ_dom, difference(clamped_pidrt_h, disp_h, slope_h, x_square)) >
+              sum(displ_dom, difference(clamped_pidrt_v, disp_v, slope_v, y_square));
+      RDom slope_dom(0, n_slopes());
+      // Both outputs read the same argmax, so that a manual schedule can compute it once
+      best(y_square, x_square, frame) = Halide::argmax(slope_dom, V(slope_dom,
+                                                                    clamp(y_square, 0, n_squares_x - 1),
+                                                                    clamp(x_square, 0, n_squares_y - 1),
+                                                                    frame));
+      Expr best_slope = best(y_square, x_square, frame)[0];
+      slopes(y_square, x_square, frame) = i16(
+              select(is_horizontal(clamp(best_slope, 0, n_slopes() - 1), y_square, x_square, frame), best_slope,
+                     n_slopes() + best_slope));
+//      slopes(y_square, x_square) = i16(res[0]);
+      intensities(y_square, x_square, frame) = i16(best(y_square, x_square, frame)[1]);
+   }
+
+   void schedule() {
+      if (using_autoscheduler()) {
+         pidrt_h.dim(0).set_estimate(0, n_squares());
+         pidrt_h.dim(1).set_estimate(0, n_slopes());
+         pidrt_h.dim(2).set_estimate(0, VAL_N);
+         pidrt_h.dim(3).set_estimate(0, frames.value());
+         pidrt_v.dim(0).set_estimate(0, n_squares());
+         pidrt_v.dim(1).set_estimate(0, n_slopes());
+         pidrt_v.dim(2).set_estimate(0, VAL_N);
+         pidrt_v.dim(3).set_estimate(0, frames.value());
+         slopes.dim(0).set_estimate(0, n_squares());
+         slopes.dim(1).set_estimate(0, n_squares());
+         slopes.dim(2).set_estimate(0, frames.value());
+         intensities.dim(0).set_estimate(0, n_squares());
+         intensities.dim(1).set_estimate(0, n_squares());
+         intensities.dim(2).set_estimate(0, frames.value());
+      } else if (get_target().has_feature(Halide::Target::OpenCL)) {
+         // By name rather than by index in get_pipeline(): one GPU block per row of squares, one thread per square
+         best.compute_root().gpu_blocks(x_square).gpu_threads(y_square);
+         slopes.gpu_blocks(x_square).gpu_threads(y_square);
+         intensities.gpu_blocks(x_square).gpu_threads(y_square);
+      } else {
+         // Used by the *_region libraries, which compute cropped outputs: no split, so any extent works. The sums
+         // of the argmax are computed per row of squares, vectorized over the slopes. The differences of the vertical
+         // DRT are computed once per row, which reads every line of them; those of the horizontal DRT once per
+         // square, whose lines span every square of the row. The argmax is shared by both outputs, and the outputs
+         // are vectorized with guards for narrow crops.
+         best.compute_root().parallel(x_square);
+         V.compute_at(best, x_square).vectorize(slope, 8, Halide::TailStrategy::GuardWithIf);
+         diff_v.compute_at(best, x_square).vectorize(dx, 8, Halide::TailStrategy::GuardWithIf);
+         diff_h.compute_at(V, x_square).vectorize(dx, 8, Halide::TailStrategy::GuardWithIf);
+         slopes.compute_root().parallel(x_square).vectorize(y_square, 8, Halide::TailStrategy::GuardWithIf);
+         intensities.compute_root().parallel(x_square).vectorize(y_square, 8, Halide::TailStrategy::GuardWithIf);
+      }
+   }
+};
+
+} // namespace
+
+HALIDE_REGISTER_GENERATOR(PartialBarDetector_generator, partial_bar_detector)
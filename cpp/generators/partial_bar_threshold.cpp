@@ -0,0 +1,131 @@
+#include "Halide.h"
+
+namespace {
+
+// partial_bar_detector and threshold_planes in one pass, for video: the intensities are thresholded relative to a
+// given normalization intensity (a moving average of the previous frames, or a fixed one) instead of the strongest
+// square of the frame itself, so each square is thresholded as soon as its argmax is known. The strongest square of
+// the frame is output too, to update the moving average
+class PartialBarThreshold_generator : public Halide::Generator<PartialBarThreshold_generator> {
+private:
+   const int VAL_N = 1024;
+   // Score of the threshold in the score plane, Detections::score_scale on the host side
+   const int score_scale = 64;
+
+public:
+   Var x_square{"y_square"};
+   Var y_square{"x_square"};
+   Var x_byte{"x_byte"};
+   Var slope{"slope"};
+   Var frame{"frame"};
+   Input <Buffer<int16_t>> pidrt_h{"pidrt_h", 4};
+   Input <Buffer<int16_t>> pidrt_v{"pidrt_v", 4};
+   // Intensity the threshold is relative to, in place of the strongest square of the frame
+   Input <float> normalization{"normalization", 1000.0f};
+   Output <Buffer<uint8_t>> angles{"angles", 3};
+   Output <Buffer<uint8_t>> scores{"scores", 3};
+   Output <Buffer<uint8_t>> mask{"mask", 3};
+   Output <Buffer<int16_t>> peak{"peak", 1};
+   // Operating point of the DRTs and threshold, see partial_threshold_jet
+   GeneratorParam<int32_t> tile_size{"tile_size", 32};
+   GeneratorParam<int32_t> stride{"stride", 2};
+   GeneratorParam<float> threshold{"threshold", 0.1832f};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
+   Func is_horizontal;
+   Func best{"best"};
+   Func above{"above"};
+
+   // Slopes of the last DRT stage
+   int n_slopes() const {
+      return 2 * tile_size.value() - 1;
+   }
+
+   // Nominal square count for the schedule estimates
+   int n_squares() const {
+      return (VAL_N - tile_size.value()) / stride.value() + 1;
+   }
+
+   void generate() {
+      using namespace Halide::ConciseCasts;
+      // Bar detector, as in partial_bar_detector
+      Expr n_squares_x = pidrt_h.dim(2).extent();
+      Expr n_squares_y = pidrt_v.dim(2).extent();
+      Expr y_central = y_square * stride.value() + tile_size.value() / 2;
+      Expr x_central = x_square * stride.value() + tile_size.value() / 2;
+      Expr signed_slope = i32(slope) - tile_size.value() + 1;
+      RDom displ_dom(-(tile_size.value() >> 1), ((tile_size.value() >> 1) << 1) - 1);
+      Expr disp_h = y_central + displ_dom - signed_slope / 2;
+      Expr disp_v = x_central + displ_dom + signed_slope / 2;
+      Func clamped_pidrt_h = Halide::BoundaryConditions::repeat_edge(pidrt_h);
+      Func clamped_pidrt_v = Halide::BoundaryConditions::repeat_edge(pidrt_v);
+      Var dx, dy, dz;
+      Func diff_h, diff_v;
+      diff_h(dx, dy, dz, frame) = abs(clamped_pidrt_h(dx + 1, dy, dz, frame) - clamped_pidrt_h(dx, dy, dz, frame));
+      diff_v(dx, dy, dz, frame) = abs(clamped_pidrt_v(dx + 1, dy, dz, frame) - clamped_pidrt_v(dx, dy, dz, frame));
+      Expr std_h = sum(displ_dom, diff_h(disp_h, signed_slope + tile_size.value() - 1, x_square, frame));
+      Expr std_v = sum(displ_dom, diff_v(disp_v, -signed_slope + tile_size.value() - 1, y_square, frame));
+      Func V{"V"};
+      V(slope, x_square, y_square, frame) = abs(i16(std_h) - i16(std_v));
+      is_horizontal(slope, x_square, y_square, frame) = std_h > std_v;
+      RDom slope_dom(0, n_slopes());
+      best(y_square, x_square, frame) = Halide::argmax(slope_dom, V(slope_dom,
+                                                                    clamp(y_square, 0, n_squares_x - 1),
+                                                                    clamp(x_square, 0, n_squares_y - 1),
+                                                                    frame));
+      Expr best_slope = best(y_square, x_square, frame)[0];
+      Expr slope_index = select(is_horizontal(clamp(best_slope, 0, n_slopes() - 1), y_square, x_square, frame),
+                                best_slope, n_slopes() + best_slope);
+      Expr intensity = i16(best(y_square, x_square, frame)[1]);
+
+      // Threshold, as in threshold_planes
+      Expr relative = f32(intensity) / normalization;
+      angles(y_square, x_square, frame) = u8(255.0f * f32(slope_index) / (2 * n_slopes() - 1));
+      scores(y_square, x_square, frame) = u8_sat(round(relative / threshold.value() * score_scale));
+      above(y_square, x_square, frame) = u8(select(relative > threshold.value(), 1, 0));
+      RDom bit(0, 8);
+      Expr x = x_byte * 8 + bit;
+      mask(x_byte, x_square, frame) = sum(select(x < n_squares_x,
+                                                 above(min(x, n_squares_x - 1), x_square, frame) << u8(bit),
+                                                 u8(0)));
+
+      RDom squares_dom(0, n_squares_x, 0, n_squares_y);
+      peak(frame) = i16(maximum(squares_dom, best(squares_dom.x, squares_dom.y, frame)[1]));
+   }
+
+   void schedule() {
+      if (using_autoscheduler()) {
+         pidrt_h.dim(0).set_estimate(0, n_squares());
+         pidrt_h.dim(1).set_estimate(0, n_slopes());
+         pidrt_h.dim(2).set_estimate(0, VAL_N);
+         pidrt_h.dim(3).set_estimate(0, frames.value());
+         pidrt_v.dim(0).set_estimate(0, n_squares());
+         pidrt_v.dim(1).set_estimate(0, n_slopes());
+         pidrt_v.dim(2).set_estimate(0, VAL_N);
+         pidrt_v.dim(3).set_estimate(0, frames.value());
+         normalization.set_estimate(1000.0f);
+         angles.dim(0).set_estimate(0, n_squares());
+         angles.dim(1).set_estimate(0, n_squares());
+         angles.dim(2).set_estimate(0, frames.value());
+         scores.dim(0).set_estimate(0, n_squares());
+         scores.dim(1).set_estimate(0, n_squares());
+         scores.dim(2).set_estimate(0, frames.value());
+         mask.dim(0).set_estimate(0, (n_squares() + 7) / 8);
+         mask.dim(1).set_estimate(0, n_squares());
+         mask.dim(2).set_estimate(0, frames.value());
+         peak.dim(0).set_estimate(0, frames.value());
+      } else {
+         // The argmax is computed once and read by every output, none of which waits for a reduction over the
+         // frame
+         best.compute_root().parallel(x_square);
+         angles.compute_root().parallel(x_square).vectorize(y_square, 16, Halide::TailStrategy::GuardWithIf);
+         scores.compute_root().parallel(x_square).vectorize(y_square, 16, Halide::TailStrategy::GuardWithIf);
+         mask.compute_root().parallel(x_square);
+         peak.compute_root();
+      }
+   }
+};
+
+} // namespace
+
+HALIDE_REGISTER_GENERATOR(PartialBarThreshold_generator, partial_bar_threshold)
@@ -0,0 +1,157 @@
+#include "Halide.h"
+
+// Partial strided DRT: the DRT recursion stops at squares of tile_size lines, and the squares of each stage are
+// stride lines apart at most. PS DRT is tile_size=32 stride=2, PDRT 2 is 2/2 and PDRT 32 is 32/32
+class PartialDRTGenerator : public Halide::Generator<PartialDRTGenerator> {
+private:
+   Var i, j;
+   int32_t STRIDE = 0;
+   int32_t TILE_SIZE = 0;
+   // Nominal input side used by the schedules, the algorithm reads the extents of `in`
+   const int32_t VAL_N = 1024;
+   int32_t stride_bits = 0;
+   int32_t tile_size_bits = 0;
+   Var x{"ySquareMp1"}, y{"_slope"}, c{"writeIdx"}, frame{"frame"};
+   Halide::Func in_rows{"in_rows"};
+   std::vector<Halide::Func> fm;
+
+public:
+   Input <Buffer<uint8_t>> in{"in", 3};
+   Output <Buffer<int16_t>> out{"out", 4};
+   GeneratorParam<bool> transpose{"transpose", false};
+   // Operating point, both powers of two with stride <= tile_size
+   GeneratorParam<int32_t> tile_size{"tile_size", 32};
+   GeneratorParam<int32_t> stride{"stride", 2};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
+
+   void generate() {
+      STRIDE = stride.value();
+      TILE_SIZE = tile_size.value();
+      stride_bits = (int32_t) std::log2(STRIDE);
+      tile_size_bits = (int32_t) std::log2(TILE_SIZE);
+      user_assert((1 << stride_bits) == STRIDE && (1 << tile_size_bits) == TILE_SIZE && STRIDE <= TILE_SIZE)
+         << "tile_size and stride must be powers of two with stride <= tile_size\n";
+      fm = std::vector<Halide::Func>(tile_size_bits + 1);
+      Var ySquareMp1 = x;
+      Var _slope = y;
+      Var writeIdx = c;
+      Var readIdx = c;
+      // The luma samples may be interleaved with chroma (YUYV), see common/frame_format.h
+      in.dim(0).set_stride(Expr());
+      // Length of the projected lines and number of lines, taken from the input at runtime
+      Expr n_write = transpose.value() ? in.dim(1).extent() : in.dim(0).extent();
+      Expr n_lines = transpose.value() ? in.dim(0).extent() : in.dim(1).extent();
+      if (transpose) {
+         // The columns of the input are the lines: a transposed copy lets the stages read them as rows
+         in_rows(i, j, frame) = in(clamp(j, 0, n_lines - 1), clamp(i, 0, n_write - 1), frame);
+         fm[0](writeIdx, _slope, ySquareMp1, frame) = cast<int16_t>(in_rows(writeIdx, ySquareMp1, frame));
+      } else {
+         fm[0](writeIdx, _slope, ySquareMp1, frame) = cast<int16_t>(
+            in(clamp(writeIdx, 0, n_write - 1), clamp(ySquareMp1, 0, n_lines - 1), frame));
+      }
+      for (int32_t m = 0; m < tile_size_bits; m++) {
+         int32_t M = 1 << m;
+         int32_t Mp1 = 1 << (m + 1);
+         Expr nSquaresMp1 = ((n_lines - std::min(Mp1, TILE_SIZE)) / std::min(Mp1, STRIDE)) + 1;
+         int32_t in_slope_size = 2 * M - 1;
+         Expr slope = _slope - Mp1 + 1;
+         Expr abs_s = abs(slope);
+         Expr s2 = abs_s >> 1; // floor (half of the absolute slope)
+         Expr rs = abs_s - 2 * s2; // Remainder of the absolute slope
+         Expr s_sign = select(slope < 0, -1, 1);
+         Expr slopeM = M - 1 + s2 * s_sign;
+         Expr incIndB = s_sign * (s2 + rs);
+         Expr A = select((readIdx >= n_write) || (readIdx < 0),
+                         0,
+                         m < stride_bits,
+                         fm[m](clamp(readIdx, 0, n_write - 1),
+                               clamp(slopeM, 0, in_slope_size - 1),
+                               clamp(ySquareMp1 << 1, 0, nSquaresMp1 * 2 - 2),
+                               frame),
+                         fm[m](clamp(readIdx, 0, n_write - 1),
+                               clamp(slopeM, 0, in_slope_size - 1),
+                               clamp(ySquareMp1, 0, nSquaresMp1 - 1),
+                               frame
+                         ));
+
+         Expr B = select((readIdx + incIndB < 0) || (readIdx + incIndB >= n_write),
+                         0,
+                         m < stride_bits,
+                         fm[m](clamp(readIdx + incIndB, 0, n_write - 1),
+                               clamp(slopeM, 0, in_slope_size - 1),
+                               clamp((ySquareMp1 << 1) + 1, 0, (nSquaresMp1 << 1) - 1),
+                               frame),
+                         fm[m](clamp(readIdx + incIndB, 0, n_write - 1),
+                               clamp(slopeM, 0, in_slope_size - 1),
+                               clamp(ySquareMp1 + m - stride_bits + 1, 0, nSquaresMp1 + m - stride_bits),
+                               frame
+                         ));
+         fm[m + 1](writeIdx, _slope, ySquareMp1, frame) = A + B;
+      }
+      out = fm[tile_size_bits];
+   }
+
+   void schedule() {
+      if (using_autoscheduler()) {
+         in.dim(0).set_estimate(0, VAL_N);
+         in.dim(1).set_estimate(0, VAL_N);
+         in.dim(2).set_estimate(0, frames.value());
+         for (int32_t m = 1; m <= tile_size_bits; m++) {
+            int32_t M = 1 << m;
+            int32_t n_squares = (VAL_N - std::min(M, TILE_SIZE)) / std::min(M, STRIDE) + 1;
+            Halide::Func f = m == tile_size_bits ? Halide::Func(out) : fm[m];
+            f.set_estimate(x, 0, n_squares)
+               .set_estimate(y, 0, 2 * M - 1)
+               .set_estimate(c, 0, 1024)
+               .set_estimate(frame, 0, frames.value());
+         }
+      } else {
+         // Used by the *_region libraries, which compute cropped outputs: a crop may hold fewer squares than a
+         // task, so the split guards its tail, and the crops span at least 16 line positions
+         if (transpose)
+            schedule_in_rows();
+         Var xo{"xo"}, xi{"xi"};
+         const int32_t squares_per_task = 32;
+         out.compute_root()
+            .split(x, xo, xi, squares_per_task, Halide::TailStrategy::GuardWithIf)
+            .parallel(xo)
+            .vectorize(c, 16);
+         // Square x of stage m + 1 reads the squares 2x and 2x + 1 of stage m while m < stride_bits, and the squares
+         // x and x + m - stride_bits + 1 after that, so the squares of a stage an output square reads form a window
+         // that only moves forward with it. Each task slides the stages along its squares, and their storage is
+         // folded to that window
+         int32_t window = 1;
+         for (int32_t m = tile_size_bits - 1; m >= 1; m--) {
+            window = m < stride_bits ? 2 * window : window + m - stride_bits + 1;
+            int32_t fold = 1;
+            while (fold < window)
+               fold *= 2;
+            fm[m].store_at(out, xo).compute_at(out, xi).vectorize(c, 16).fold_storage(x, fold);
+         }
+         // Vector loads of dense luma, the same stage reads interleaved luma with its stride
+         if (!transpose)
+            fm[1].specialize(in.dim(0).stride() == 1);
+      }
+   } // schedule
+
+private:
+   // Blocked transpose of the manual schedule: each 16x16 block of the input is loaded with 16 row vectors, and the
+   // unrolled transposed copy reads it back from registers, so that no stage reads the input a column at a time.
+   // Autoscheduled builds leave in_rows to the autoscheduler
+   void schedule_in_rows() {
+      Var io{"io"}, jo{"jo"}, ii{"ii"}, ji{"ji"};
+      Halide::Func block = in.in(in_rows);
+      in_rows.compute_root()
+         .tile(i, j, io, jo, ii, ji, 16, 16, Halide::TailStrategy::GuardWithIf)
+         .vectorize(ii)
+         .unroll(ji)
+         .parallel(jo);
+      block.compute_at(in_rows, io)
+         .vectorize(block.args()[0], 16, Halide::TailStrategy::GuardWithIf)
+         .unroll(block.args()[1]);
+      block.specialize(in.dim(0).stride() == 1);
+   }
+};
+
+HALIDE_REGISTER_GENERATOR(PartialDRTGenerator, partial_drt)
@@ -0,0 +1,91 @@
+#include "Halide.h"
+
+namespace {
+
+// Thresholding and jet coloring of the output of partial_bar_detector, for the same operating point
+class PartialThresholdJet_generator : public Halide::Generator<PartialThresholdJet_generator> {
+private:
+   const int VAL_N = 1024;
+
+public:
+   Var x_square{"y_square"};
+   Var y_square{"x_square"};
+   Var slope{"slope"};
+   Var frame{"frame"};
+   Input <Buffer<int16_t>> intensities{"intensities", 3};
+   Input <Buffer<int16_t>> slopes{"slopes", 3};
+   Input <Buffer<uint8_t>> jet_r{"jet_lookup_r", 1};
+   Input <Buffer<uint8_t>> jet_g{"jet_lookup_g", 1};
+   Input <Buffer<uint8_t>> jet_b{"jet_lookup_b", 1};
+   Output <Buffer<uint8_t>> output{"output", 4};
+   // Operating point of the DRTs, see partial_bar_detector, and the threshold relative to the strongest square
+   GeneratorParam<int32_t> tile_size{"tile_size", 32};
+   GeneratorParam<int32_t> stride{"stride", 2};
+   GeneratorParam<float> threshold{"threshold", 0.1832f};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
+   Func mask{"mask"};
+   Func indices{"indices"};
+   Func max_intensity{"max_intensity"};
+
+   // Slopes of the bar detector output, both orientations
+   int n_slopes() const {
+      return 2 * (2 * tile_size.value() - 1) - 1;
+   }
+
+   // Nominal square count for the schedule estimates
+   int n_squares() const {
+      return (VAL_N - tile_size.value()) / stride.value() + 1;
+   }
+
+   void generate() {
+      using namespace Halide::ConciseCasts;
+      RDom slope_dom(0, n_slopes());
+      RDom intensities_dom(0, intensities.dim(0).extent(), 0, intensities.dim(1).extent());
+      max_intensity(frame) = maximum(intensities_dom, intensities(intensities_dom.x, intensities_dom.y, frame));
+
+      // Threshold
+      Expr relative = f32(intensities(x_square, y_square, frame)) / f32(max_intensity(frame));
+      mask(x_square, y_square, frame) = u8(select(relative > threshold.value(), 1, 0));
+
+      indices(x_square, y_square, frame) = u8(255.0f * f32(slopes(x_square, y_square, frame)) / n_slopes());
+
+      // Jet-colorspace
+      Var color_channel;
+      Expr index = indices(x_square, y_square, frame);
+      Expr masked = mask(x_square, y_square, frame);
+      output(x_square, y_square, color_channel, frame) = select(color_channel == 0,
+                                                                jet_b(index) * masked,
+                                                                color_channel == 1,
+                                                                jet_g(index) * masked,
+                                                                jet_r(index) * masked);
+   }
+
+   void schedule() {
+      if (using_autoscheduler()) {
+         intensities.dim(0).set_estimate(0, n_squares());
+         intensities.dim(1).set_estimate(0, n_squares());
+         intensities.dim(2).set_estimate(0, frames.value());
+         slopes.dim(0).set_estimate(0, n_squares());
+         slopes.dim(1).set_estimate(0, n_squares());
+         slopes.dim(2).set_estimate(0, frames.value());
+         jet_r.dim(0).set_estimate(0, 256);
+         jet_g.dim(0).set_estimate(0, 256);
+         jet_b.dim(0).set_estimate(0, 256);
+         output.dim(0).set_estimate(0, n_squares());
+         output.dim(1).set_estimate(0, n_squares());
+         output.dim(2).set_estimate(0, 3);
+         output.dim(3).set_estimate(0, frames.value());
+      } else {
+         // The maximum is reduced once per frame rather than at every square
+         max_intensity.compute_root();
+         output.compute_root()
+            .parallel(y_square)
+            .vectorize(x_square, 16, Halide::TailStrategy::GuardWithIf);
+      }
+   }
+};
+
+} // namespace
+
+HALIDE_REGISTER_GENERATOR(PartialThresholdJet_generator, partial_threshold_jet)
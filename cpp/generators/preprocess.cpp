@@ -0,0 +1,85 @@
+#include "Halide.h"
+
+namespace {
+
+// Raw camera luma to the working image of the detectors: bilinear resample to width x height, with pixel centers
+// aligned as cv2.resize does, then min/max contrast stretch to 0..255 as in the Python reference. The resampled
+// image is not stored, the reduction and the output each recompute it
+class Preprocess_generator : public Halide::Generator<Preprocess_generator> {
+private:
+   // Nominal sizes for the schedule estimates
+   const int VAL_IN_WIDTH = 1920;
+   const int VAL_IN_HEIGHT = 1080;
+   const int VAL_N = 1024;
+   Func resized{"resized"};
+   Func row_range{"row_range"};
+   Func range{"range"};
+
+public:
+   Var x{"x"}, y{"y"}, frame{"frame"};
+   // Any strides, see common/frame_format.h
+   Input <Buffer<uint8_t>> in{"in", 3};
+   Input <int32_t> width{"width", 1024};
+   Input <int32_t> height{"height", 1024};
+   Output <Buffer<uint8_t>> output{"output", 3};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
+
+   void generate() {
+      using namespace Halide::ConciseCasts;
+      // The resample gathers its taps, so interleaved luma costs no more than dense luma
+      in.dim(0).set_stride(Expr());
+      Expr in_width = in.dim(0).extent();
+      Expr in_height = in.dim(1).extent();
+      Expr in_x = (f32(x) + 0.5f) * (f32(in_width) / f32(width)) - 0.5f;
+      Expr in_y = (f32(y) + 0.5f) * (f32(in_height) / f32(height)) - 0.5f;
+      Expr x0 = i32(floor(in_x));
+      Expr y0 = i32(floor(in_y));
+      Expr fx = in_x - f32(x0);
+      Expr fy = in_y - f32(y0);
+      auto pixel = [&](Expr px, Expr py) {
+         return f32(in(clamp(px, 0, in_width - 1), clamp(py, 0, in_height - 1), frame));
+      };
+      Expr top = lerp(pixel(x0, y0), pixel(x0 + 1, y0), fx);
+      Expr bottom = lerp(pixel(x0, y0 + 1), pixel(x0 + 1, y0 + 1), fx);
+      resized(x, y, frame) = u8_sat(lerp(top, bottom, fy) + 0.5f);
+
+      // Darkest and brightest resampled pixel of each row, then of each frame
+      RDom rx(0, width);
+      row_range(y, frame) = Tuple(u8(255), u8(0));
+      row_range(y, frame) = Tuple(min(row_range(y, frame)[0], resized(rx, y, frame)),
+                                  max(row_range(y, frame)[1], resized(rx, y, frame)));
+      RDom ry(0, height);
+      range(frame) = Tuple(u8(255), u8(0));
+      range(frame) = Tuple(min(range(frame)[0], row_range(ry, frame)[0]),
+                           max(range(frame)[1], row_range(ry, frame)[1]));
+
+      // Flat frames, whose stretch is undefined, come out black
+      Expr darkest = i32(range(frame)[0]);
+      Expr contrast = max(i32(range(frame)[1]) - darkest, 1);
+      output(x, y, frame) = u8((i32(resized(x, y, frame)) - darkest) * 255 / contrast);
+   }
+
+   void schedule() {
+      if (using_autoscheduler()) {
+         in.dim(0).set_estimate(0, VAL_IN_WIDTH);
+         in.dim(1).set_estimate(0, VAL_IN_HEIGHT);
+         in.dim(2).set_estimate(0, frames.value());
+         width.set_estimate(VAL_N);
+         height.set_estimate(VAL_N);
+         output.dim(0).set_estimate(0, VAL_N);
+         output.dim(1).set_estimate(0, VAL_N);
+         output.dim(2).set_estimate(0, frames.value());
+      } else {
+         row_range.compute_root().parallel(y);
+         range.compute_root();
+         output.compute_root()
+            .parallel(y)
+            .vectorize(x, 16, Halide::TailStrategy::GuardWithIf);
+      }
+   }
+};
+
+} // namespace
+
+HALIDE_REGISTER_GENERATOR(Preprocess_generator, preprocess)
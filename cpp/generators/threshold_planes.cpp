@@ -0,0 +1,80 @@
+#include "Halide.h"
+
+namespace {
+
+// Same threshold as ps_threshold_jet, pdrt2_threshold_jet and pdrt32_threshold_jet, without the jet coloring: the
+// output is an angle index plane, a score plane and a mask packing 8 squares along x per byte
+class ThresholdPlanes_generator : public Halide::Generator<ThresholdPlanes_generator> {
+private:
+   // Score of the threshold in the score plane, Detections::score_scale on the host side
+   const int score_scale = 64;
+
+public:
+   Var x_square{"y_square"};
+   Var y_square{"x_square"};
+   Var x_byte{"x_byte"};
+   Var frame{"frame"};
+   Input <Buffer<int16_t>> intensities{"intensities", 3};
+   Input <Buffer<int16_t>> slopes{"slopes", 3};
+   Output <Buffer<uint8_t>> angles{"angles", 3};
+   Output <Buffer<uint8_t>> scores{"scores", 3};
+   Output <Buffer<uint8_t>> mask{"mask", 3};
+   // Slope range and threshold of the detector, see its threshold_jet generator
+   GeneratorParam<int32_t> n_slopes{"n_slopes", 125};
+   GeneratorParam<float> threshold{"threshold", 0.1832f};
+   // Nominal square count for the schedule estimates
+   GeneratorParam<int32_t> n_squares{"n_squares", 497};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
+   Func above{"above"};
+   Func max_intensity{"max_intensity"};
+
+   void generate() {
+      using namespace Halide::ConciseCasts;
+      Expr n_squares_x = intensities.dim(0).extent();
+      RDom intensities_dom(0, intensities.dim(0).extent(), 0, intensities.dim(1).extent());
+      max_intensity(frame) = maximum(intensities_dom, intensities(intensities_dom.x, intensities_dom.y, frame));
+      Expr relative = f32(intensities(x_square, y_square, frame)) / f32(max_intensity(frame));
+
+      angles(x_square, y_square, frame) = u8(255.0f * f32(slopes(x_square, y_square, frame)) / n_slopes.value());
+      scores(x_square, y_square, frame) = u8_sat(round(relative / threshold.value() * score_scale));
+
+      // Threshold, packed
+      above(x_square, y_square, frame) = u8(select(relative > threshold.value(), 1, 0));
+      RDom bit(0, 8);
+      Expr x = x_byte * 8 + bit;
+      mask(x_byte, y_square, frame) = sum(select(x < n_squares_x,
+                                                 above(min(x, n_squares_x - 1), y_square, frame) << u8(bit),
+                                                 u8(0)));
+   }
+
+   void schedule() {
+      if (using_autoscheduler()) {
+         intensities.dim(0).set_estimate(0, n_squares.value());
+         intensities.dim(1).set_estimate(0, n_squares.value());
+         intensities.dim(2).set_estimate(0, frames.value());
+         slopes.dim(0).set_estimate(0, n_squares.value());
+         slopes.dim(1).set_estimate(0, n_squares.value());
+         slopes.dim(2).set_estimate(0, frames.value());
+         angles.dim(0).set_estimate(0, n_squares.value());
+         angles.dim(1).set_estimate(0, n_squares.value());
+         angles.dim(2).set_estimate(0, frames.value());
+         scores.dim(0).set_estimate(0, n_squares.value());
+         scores.dim(1).set_estimate(0, n_squares.value());
+         scores.dim(2).set_estimate(0, frames.value());
+         mask.dim(0).set_estimate(0, (n_squares.value() + 7) / 8);
+         mask.dim(1).set_estimate(0, n_squares.value());
+         mask.dim(2).set_estimate(0, frames.value());
+      } else {
+         // The maximum is reduced once per frame rather than at every square
+         max_intensity.compute_root();
+         angles.compute_root().parallel(y_square).vectorize(x_square, 16, Halide::TailStrategy::GuardWithIf);
+         scores.compute_root().parallel(y_square).vectorize(x_square, 16, Halide::TailStrategy::GuardWithIf);
+         mask.compute_root().parallel(y_square);
+      }
+   }
+};
+
+} // namespace
+
+HALIDE_REGISTER_GENERATOR(ThresholdPlanes_generator, threshold_planes)
@@ -0,0 +1,147 @@
+#include "Halide.h"
+
+namespace {
+
+// Unpool followed by convolutions, without the dense unpooled activations in between. The new activations of unpool
+// are non-zero in a single slope and a single square of each 2x2 cell of fine squares, so they are kept as one
+// (index, value) pair per cell, the index being output slope * 4 + row in the cell * 2 + column in the cell. The first
+// smoothing pass reads that pair and the weighted original activations straight from the fine encoder. Same results
+// as unpool and convolutions.
+class UnpoolConvolutions_generator : public Halide::Generator<UnpoolConvolutions_generator> {
+private:
+   const int VAL_N = 1024;
+   // Called for the unpool stages 1 to 4, as unpool
+   const int16_t coarse_slope_size[5] = {126, 62, 30, 30, 30};
+   const int16_t fine_slope_size[5] = {-1, 62, 30, 14, 6};
+   // Nominal fine square counts for the schedule estimates
+   const int16_t fine_wh_size[5] = {-1, 64, 128, 256, 512};
+
+public:
+   Input <Buffer<int16_t>> coarse_activations{"coarse_activations", 4};
+   Input <Buffer<int16_t>> fine_activations{"fine_activations", 4};
+   Input<float> weight_new{"weight_new", 1.0f};
+   Input<float> weight_original{"weight_original", 1.0f};
+   Output <Buffer<int16_t>> filter_vhd{"filter_vhd", 4};
+   GeneratorParam <uint8_t> stage{"stage", 0};
+   // Number of frames per call the schedule is tuned for
+   GeneratorParam<int32_t> frames{"frames", 1};
+   Var x_square{"x_square"};
+   Var y_square{"y_square"};
+   Var x_cell{"x_cell"};
+   Var y_cell{"y_cell"};
+   Var slope{"slope"};
+   Var frame{"frame"};
+   Func cells{"cells"};
+   Func unpooled{"unpooled"};
+   Func filter_v{"filter_v"};
+   Func filter_vh{"filter_vh"};
+   Func filter_v2{"filter_v2"};
+   Func filter_vh2{"filter_vh2"};
+
+   void generate() {
+      using namespace Halide::ConciseCasts;
+      Expr n_squares_fine_x = fine_activations.dim(1).extent();
+      Expr n_squares_fine_y = fine_activations.dim(2).extent();
+      Expr n_squares_coarse_x = coarse_activations.dim(1).extent();
+      Expr n_squares_coarse_y = coarse_activations.dim(2).extent();
+      int16_t n_slopes_fine = fine_slope_size[stage.value()];
+      int16_t n_slopes_coarse = coarse_slope_size[stage.value() - 1];
+      int16_t n_slopes_output = coarse_slope_size[stage.value()];
+      int slope_ratio = n_slopes_coarse / n_slopes_fine;
+      float new_activations_slope_ratio = (float) n_slopes_coarse / (float) n_slopes_output;
+
+      // Arg max over the coarse slopes, then over the 2x2 fine squares of the cell, as in unpool
+      RDom slope_dom(0, n_slopes_coarse);
+      Tuple coarse_max = argmax(slope_dom, coarse_activations(clamp(slope_dom, 0, n_slopes_coarse - 1),
+                                                              clamp(x_cell, 0, n_squares_coarse_x - 1),
+                                                              clamp(y_cell, 0, n_squares_coarse_y - 1),
+                                                              frame));
+      Expr max_slope_indices = coarse_max[0];
+      Expr values = coarse_max[1];
+      Expr fine_activations_coarser_slope = (cast<int>(max_slope_indices) / slope_ratio) % n_slopes_fine;
+      RDom ij(0, 2, 0, 2);
+      Tuple fine_max = argmax(ij, fine_activations(clamp(fine_activations_coarser_slope, 0, n_slopes_fine - 1),
+                                                   clamp(2 * x_cell + ij.x, 0, n_squares_fine_x - 1),
+                                                   clamp(2 * y_cell + ij.y, 0, n_squares_fine_y - 1),
+                                                   frame));
+      Expr jj = fine_max[0];
+      Expr ii = fine_max[1];
+      Expr output_slope = i32(round(max_slope_indices / new_activations_slope_ratio) % n_slopes_output);
+      cells(x_cell, y_cell, frame) = Tuple(i16(output_slope * 4 + ii * 2 + jj), values);
+
+      // add_original_activations, the new activations scattered from the cells
+      Expr index = i16(slope * 4 + (y_square % 2) * 2 + x_square % 2);
+      Expr new_activations = select(index == cells(x_square / 2, y_square / 2, frame)[0],
+                                    cells(x_square / 2, y_square / 2, frame)[1],
+                                    i16(0));
+      int add_slope_ratio = n_slopes_output / n_slopes_fine;
+      unpooled(slope, x_square, y_square, frame) = i16(
+         new_activations * weight_new +
+         fine_activations(clamp((i32(slope) / i32(add_slope_ratio)) % i32(n_slopes_fine), 0, n_slopes_fine),
+                          x_square, y_square, frame) * weight_original);
+
+      // Spatial and angular smoothing, as in convolutions
+      Func clamped = Halide::BoundaryConditions::mirror_image(
+         unpooled, {{0, n_slopes_output}, {0, n_squares_fine_x}, {0, n_squares_fine_y}, {Expr(), Expr()}});
+
+      filter_v(slope, x_square, y_square, frame) =
+         clamped(slope, x_square, y_square - 1, frame) / 3 +
+         clamped(slope, x_square, y_square, frame) / 3 +
+         clamped(slope, x_square, y_square + 1, frame) / 3;
+
+      filter_vh(slope, x_square, y_square, frame) =
+         filter_v(slope, x_square - 1, y_square, frame) / 3 +
+         filter_v(slope, x_square, y_square, frame) / 3 +
+         filter_v(slope, x_square + 1, y_square, frame) / 3;
+
+      filter_v2(slope, x_square, y_square, frame) =
+         filter_vh(slope, x_square, y_square - 1, frame) / 3 +
+         filter_vh(slope, x_square, y_square, frame) / 3 +
+         filter_vh(slope, x_square, y_square + 1, frame) / 3;
+
+      filter_vh2(slope, x_square, y_square, frame) =
+         filter_v2(slope, x_square - 1, y_square, frame) / 3 +
+         filter_v2(slope, x_square, y_square, frame) / 3 +
+         filter_v2(slope, x_square + 1, y_square, frame) / 3;
+
+      filter_vhd(slope, x_square, y_square, frame) =
+         (filter_vh2((slope - 1) % n_slopes_output, x_square, y_square, frame)) / 4 +
+         (filter_vh2(slope, x_square, y_square, frame)) / 2 +
+         (filter_vh2((slope + 1) % n_slopes_output, x_square, y_square, frame)) / 4;
+   }
+
+   void schedule() {
+      if (using_autoscheduler()) {
+         int n_squares_fine = fine_wh_size[stage.value()];
+         int n_slopes_fine = fine_slope_size[stage.value()];
+         int n_slopes_coarse = coarse_slope_size[stage.value() - 1];
+         int n_slopes_output = coarse_slope_size[stage.value()];
+         coarse_activations.dim(0).set_estimate(0, n_slopes_coarse);
+         coarse_activations.dim(1).set_estimate(0, n_squares_fine / 2);
+         coarse_activations.dim(2).set_estimate(0, n_squares_fine / 2);
+         coarse_activations.dim(3).set_estimate(0, frames.value());
+         fine_activations.dim(0).set_estimate(0, n_slopes_fine);
+         fine_activations.dim(1).set_estimate(0, n_squares_fine);
+         fine_activations.dim(2).set_estimate(0, n_squares_fine);
+         fine_activations.dim(3).set_estimate(0, frames.value());
+         filter_vhd.dim(0).set_estimate(0, n_slopes_output);
+         filter_vhd.dim(1).set_estimate(0, n_squares_fine);
+         filter_vhd.dim(2).set_estimate(0, n_squares_fine);
+         filter_vhd.dim(3).set_estimate(0, frames.value());
+         weight_new.set_estimate(1.0f);
+         weight_original.set_estimate(1.0f);
+      } else {
+         // The cells take a quarter of a slope plane. The unpooled activations and the first vertical pass are
+         // inlined into the first horizontal pass, the other passes go through memory as in convolutions and are
+         // vectorized over the slopes in the same way
+         cells.compute_root().parallel(y_cell);
+         filter_vh.compute_root().parallel(y_square).vectorize(slope, 8, Halide::TailStrategy::GuardWithIf);
+         filter_vh2.compute_root().parallel(y_square).vectorize(slope, 8, Halide::TailStrategy::GuardWithIf);
+         filter_vhd.compute_root().parallel(y_square).vectorize(slope, 8, Halide::TailStrategy::GuardWithIf);
+      }
+   }
+};
+
+} // namespace
+
+HALIDE_REGISTER_GENERATOR(UnpoolConvolutions_generator, unpool_convolutions)
@@ -1,40 +1,868 @@
+#include <algorithm>
 #include <iostream>
 
 #include "halide_benchmark.h"
 #include "halide_image_io.h"
 #include "../common/image_utils.h"
+#include "../common/drt_geometry.h"
+#include "../common/detections.h"
+#include "../common/roi.h"
+#include "../common/instrumentation.h"
+#include "../common/cpu_dispatch.h"
+#include "../common/thread_pool.h"
+#include "../common/frame_format.h"
+#include "../common/preprocess.h"
 #include "../common/multiscale_domain_detector_drt.h"
+#include "../common/multiscale_domain_detector_fused.h"
 #include "../common/partial_strided_drt.h"
 #include "../common/partial_drt32.h"
 #include "../common/partial_drt2.h"
+#include "../common/cascade_detector.h"
+#include "../common/partial_drt_registry.h"
+#include "../common/detection_server.h"
 
 
+extern "C"
+uint8_t *run_mdd_drt_sized(uint8_t *input_data, int width, int height,
+                           double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                           double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = MDDDRT::run(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0,
+                                   threshold);
+   return output_image.data();
+}
+
 extern "C"
 uint8_t *run_mdd_drt(uint8_t *input_data,
                    double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
                    double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold) {
-   Halide::Runtime::Buffer<uint8_t> input(input_data, 1024, 1024);
-   auto output_image = MDDDRT::run(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1, w_new_0,
-                                   threshold);
+   return run_mdd_drt_sized(input_data, 1024, 1024, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2,
+                            w_new_1, w_new_0, threshold);
+}
+
+extern "C"
+uint8_t *run_mdd_fused_sized(uint8_t *input_data, int width, int height,
+                             double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                             double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = MDDFused::run(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3, w_new_2, w_new_1,
+                                     w_new_0, threshold);
    return output_image.data();
 }
 
 extern "C"
-uint8_t *run_ps_drt(uint8_t *input_data) {
-   Halide::Runtime::Buffer<uint8_t> input(input_data, 1024, 1024);
+uint8_t *run_ps_drt_sized(uint8_t *input_data, int width, int height) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
    auto output_image = PSDRT::run(input);
    return output_image.data();
 }
 
 extern "C"
-uint8_t *run_pdrt2(uint8_t *input_data) {
-   Halide::Runtime::Buffer<uint8_t> input(input_data, 1024, 1024);
+uint8_t *run_ps_drt(uint8_t *input_data) {
+   return run_ps_drt_sized(input_data, 1024, 1024);
+}
+
+extern "C"
+uint8_t *run_pdrt2_sized(uint8_t *input_data, int width, int height) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
    auto output_image = PDRT2::run(input);
    return output_image.data();
 }
+
 extern "C"
-uint8_t *run_pdrt32(uint8_t *input_data) {
-   Halide::Runtime::Buffer<uint8_t> input(input_data, 1024, 1024);
+uint8_t *run_pdrt2(uint8_t *input_data) {
+   return run_pdrt2_sized(input_data, 1024, 1024);
+}
+
+extern "C"
+uint8_t *run_pdrt32_sized(uint8_t *input_data, int width, int height) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
    auto output_image = PDRT32::run(input);
    return output_image.data();
 }
+
+extern "C"
+uint8_t *run_pdrt32(uint8_t *input_data) {
+   return run_pdrt32_sized(input_data, 1024, 1024);
+}
+
+// Width and height of the (width, height, 3) image returned for an input of the given size
+extern "C"
+void mdd_drt_output_size(int width, int height, int *output_width, int *output_height) {
+   *output_width = DRTGeometry::n_squares(width, 32, 32, 1);
+   *output_height = DRTGeometry::n_squares(height, 32, 32, 1);
+}
+
+extern "C"
+void ps_drt_output_size(int width, int height, int *output_width, int *output_height) {
+   *output_width = DRTGeometry::n_squares(width, 32, 2, 5);
+   *output_height = DRTGeometry::n_squares(height, 32, 2, 5);
+}
+
+extern "C"
+void pdrt2_output_size(int width, int height, int *output_width, int *output_height) {
+   *output_width = DRTGeometry::n_squares(width, 2, 2, 1);
+   *output_height = DRTGeometry::n_squares(height, 2, 2, 1);
+}
+
+extern "C"
+void pdrt32_output_size(int width, int height, int *output_width, int *output_height) {
+   *output_width = DRTGeometry::n_squares(width, 32, 32, 5);
+   *output_height = DRTGeometry::n_squares(height, 32, 32, 5);
+}
+
+extern "C"
+void partial_drt_output_size(int tile_size, int stride, int width, int height, int *output_width,
+                             int *output_height) {
+   int last_stage = DRTGeometry::last_stage(tile_size);
+   *output_width = DRTGeometry::n_squares(width, tile_size, stride, last_stage);
+   *output_height = DRTGeometry::n_squares(height, tile_size, stride, last_stage);
+}
+
+// Per-caller contexts, so that several threads can run the detectors at the same time
+extern "C"
+void *mdd_drt_context_create() {
+   return new MDDDRT::Context();
+}
+
+extern "C"
+void mdd_drt_context_destroy(void *context) {
+   delete static_cast<MDDDRT::Context *>(context);
+}
+
+extern "C"
+uint8_t *run_mdd_drt_context(void *context, uint8_t *input_data, int width, int height,
+                             double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                             double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<MDDDRT::Context *>(context)->run(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0,
+                                                                    w_new_3, w_new_2, w_new_1, w_new_0, threshold);
+   return output_image.data();
+}
+
+// Same as run_mdd_drt_context(), running independent stages at the same time
+extern "C"
+uint8_t *run_mdd_drt_concurrent_context(void *context, uint8_t *input_data, int width, int height,
+                                        double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                                        double w_new_3, double w_new_2, double w_new_1, double w_new_0,
+                                        double threshold) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<MDDDRT::Context *>(context)->run_concurrent(input, w_orig_3, w_orig_2, w_orig_1,
+                                                                               w_orig_0, w_new_3, w_new_2, w_new_1,
+                                                                               w_new_0, threshold);
+   return output_image.data();
+}
+
+// Consecutive frames of a video on one context: only the tiles that changed since the previous frame are
+// recomputed by the DRTs and the bar detectors
+extern "C"
+uint8_t *run_mdd_drt_incremental_context(void *context, uint8_t *input_data, int width, int height,
+                                         double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                                         double w_new_3, double w_new_2, double w_new_1, double w_new_0,
+                                         double threshold, int change_threshold) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<MDDDRT::Context *>(context)->run_incremental(input, w_orig_3, w_orig_2, w_orig_1,
+                                                                                w_orig_0, w_new_3, w_new_2, w_new_1,
+                                                                                w_new_0, threshold,
+                                                                                change_threshold);
+   return output_image.data();
+}
+
+// Same detector as run_mdd_drt_context(), computed by the single fused pipeline
+extern "C"
+void *mdd_fused_context_create() {
+   return new MDDFused::Context();
+}
+
+extern "C"
+void mdd_fused_context_destroy(void *context) {
+   delete static_cast<MDDFused::Context *>(context);
+}
+
+extern "C"
+uint8_t *run_mdd_fused_context(void *context, uint8_t *input_data, int width, int height,
+                               double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                               double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<MDDFused::Context *>(context)->run(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0,
+                                                                      w_new_3, w_new_2, w_new_1, w_new_0, threshold);
+   return output_image.data();
+}
+
+extern "C"
+void *ps_drt_context_create() {
+   return new PSDRT::Context();
+}
+
+extern "C"
+void ps_drt_context_destroy(void *context) {
+   delete static_cast<PSDRT::Context *>(context);
+}
+
+extern "C"
+uint8_t *run_ps_drt_context(void *context, uint8_t *input_data, int width, int height) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<PSDRT::Context *>(context)->run(input);
+   return output_image.data();
+}
+
+extern "C"
+void *pdrt2_context_create() {
+   return new PDRT2::Context();
+}
+
+extern "C"
+void pdrt2_context_destroy(void *context) {
+   delete static_cast<PDRT2::Context *>(context);
+}
+
+extern "C"
+uint8_t *run_pdrt2_context(void *context, uint8_t *input_data, int width, int height) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<PDRT2::Context *>(context)->run(input);
+   return output_image.data();
+}
+
+extern "C"
+void *pdrt32_context_create() {
+   return new PDRT32::Context();
+}
+
+extern "C"
+void pdrt32_context_destroy(void *context) {
+   delete static_cast<PDRT32::Context *>(context);
+}
+
+extern "C"
+uint8_t *run_pdrt32_context(void *context, uint8_t *input_data, int width, int height) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<PDRT32::Context *>(context)->run(input);
+   return output_image.data();
+}
+
+// Context of any partial strided DRT operating point that was built, see PartialDRT::operating_points(). Returns
+// nullptr for the other tile size and stride pairs
+extern "C"
+void *partial_drt_context_create(int tile_size, int stride) {
+   const PartialDRT::OperatingPoint *point = PartialDRT::find(tile_size, stride);
+   return point ? new PartialDRT::Context(*point) : nullptr;
+}
+
+extern "C"
+void partial_drt_context_destroy(void *context) {
+   delete static_cast<PartialDRT::Context *>(context);
+}
+
+extern "C"
+uint8_t *run_partial_drt_context(void *context, uint8_t *input_data, int width, int height) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<PartialDRT::Context *>(context)->run(input);
+   return output_image.data();
+}
+
+// Normalization of the thresholds of the planes and detect entry points of the partial strided DRT contexts: 0 for
+// the strongest square of each frame, 1 for a moving average over the previous frames (`value` being the weight of
+// the newest frame, in (0, 1]), 2 for a fixed intensity (`value`, above 0). The last two threshold in the same pass as
+// the bar detector. Returns 0, or -1 for an unknown mode or a value out of range
+static int set_normalization(PartialDRT::Context *context, int mode, float value) {
+   if (mode < 0 || mode > (int) PartialDRT::Normalization::fixed)
+      return -1;
+   return context->set_normalization((PartialDRT::Normalization) mode, value) ? 0 : -1;
+}
+
+extern "C"
+int partial_drt_context_set_normalization(void *context, int mode, float value) {
+   return set_normalization(static_cast<PartialDRT::Context *>(context), mode, value);
+}
+
+extern "C"
+int ps_drt_context_set_normalization(void *context, int mode, float value) {
+   return set_normalization(static_cast<PSDRT::Context *>(context), mode, value);
+}
+
+extern "C"
+int pdrt2_context_set_normalization(void *context, int mode, float value) {
+   return set_normalization(static_cast<PDRT2::Context *>(context), mode, value);
+}
+
+extern "C"
+int pdrt32_context_set_normalization(void *context, int mode, float value) {
+   return set_normalization(static_cast<PDRT32::Context *>(context), mode, value);
+}
+
+// Caller-owned outputs: same as the run_*_context entry points, but the image is written to `output_data`, a
+// contiguous (3, output_height, output_width) array of B, G and R planes that the caller keeps, so nothing has to be
+// copied out before the next call. output_width and output_height must be those given by the *_output_size
+// functions. Returns 0, or -1 when they are not
+static bool wrap_output(uint8_t *output_data, int output_width, int output_height, int expected_width,
+                        int expected_height, Halide::Runtime::Buffer<uint8_t> &output) {
+   if (output_width != expected_width || output_height != expected_height)
+      return false;
+   output = Halide::Runtime::Buffer<uint8_t>(output_data, output_width, output_height, 3);
+   return true;
+}
+
+extern "C"
+int run_mdd_drt_context_into(void *context, uint8_t *input_data, int width, int height, uint8_t *output_data,
+                             int output_width, int output_height,
+                             double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                             double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   int expected_width, expected_height;
+   mdd_drt_output_size(width, height, &expected_width, &expected_height);
+   Halide::Runtime::Buffer<uint8_t> output;
+   if (!wrap_output(output_data, output_width, output_height, expected_width, expected_height, output))
+      return -1;
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   static_cast<MDDDRT::Context *>(context)->run_into(input, output, w_orig_3, w_orig_2, w_orig_1, w_orig_0, w_new_3,
+                                                     w_new_2, w_new_1, w_new_0, threshold);
+   return 0;
+}
+
+extern "C"
+int run_mdd_fused_context_into(void *context, uint8_t *input_data, int width, int height, uint8_t *output_data,
+                               int output_width, int output_height,
+                               double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                               double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   int expected_width, expected_height;
+   mdd_drt_output_size(width, height, &expected_width, &expected_height);
+   Halide::Runtime::Buffer<uint8_t> output;
+   if (!wrap_output(output_data, output_width, output_height, expected_width, expected_height, output))
+      return -1;
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   static_cast<MDDFused::Context *>(context)->run_into(input, output, w_orig_3, w_orig_2, w_orig_1, w_orig_0,
+                                                       w_new_3, w_new_2, w_new_1, w_new_0, threshold);
+   return 0;
+}
+
+extern "C"
+int run_ps_drt_context_into(void *context, uint8_t *input_data, int width, int height, uint8_t *output_data,
+                            int output_width, int output_height) {
+   int expected_width, expected_height;
+   ps_drt_output_size(width, height, &expected_width, &expected_height);
+   Halide::Runtime::Buffer<uint8_t> output;
+   if (!wrap_output(output_data, output_width, output_height, expected_width, expected_height, output))
+      return -1;
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   static_cast<PSDRT::Context *>(context)->run_into(input, output);
+   return 0;
+}
+
+extern "C"
+int run_pdrt2_context_into(void *context, uint8_t *input_data, int width, int height, uint8_t *output_data,
+                           int output_width, int output_height) {
+   int expected_width, expected_height;
+   pdrt2_output_size(width, height, &expected_width, &expected_height);
+   Halide::Runtime::Buffer<uint8_t> output;
+   if (!wrap_output(output_data, output_width, output_height, expected_width, expected_height, output))
+      return -1;
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   static_cast<PDRT2::Context *>(context)->run_into(input, output);
+   return 0;
+}
+
+extern "C"
+int run_pdrt32_context_into(void *context, uint8_t *input_data, int width, int height, uint8_t *output_data,
+                            int output_width, int output_height) {
+   int expected_width, expected_height;
+   pdrt32_output_size(width, height, &expected_width, &expected_height);
+   Halide::Runtime::Buffer<uint8_t> output;
+   if (!wrap_output(output_data, output_width, output_height, expected_width, expected_height, output))
+      return -1;
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   static_cast<PDRT32::Context *>(context)->run_into(input, output);
+   return 0;
+}
+
+extern "C"
+int run_partial_drt_context_into(void *context, uint8_t *input_data, int width, int height, uint8_t *output_data,
+                                 int output_width, int output_height) {
+   auto partial_drt = static_cast<PartialDRT::Context *>(context);
+   const PartialDRT::OperatingPoint &point = partial_drt->operating_point();
+   int expected_width, expected_height;
+   partial_drt_output_size(point.tile_size, point.stride, width, height, &expected_width, &expected_height);
+   Halide::Runtime::Buffer<uint8_t> output;
+   if (!wrap_output(output_data, output_width, output_height, expected_width, expected_height, output))
+      return -1;
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   partial_drt->run_into(input, output);
+   return 0;
+}
+
+// Raw output planes, without the jet coloring: an angle index and a score (64 being the threshold) per output square,
+// and a mask packing 8 squares along x per byte, (output width + 7) / 8 bytes per row. The planes are owned by the
+// context and overwritten by its next call
+static void plane_pointers(const Detections::Planes &planes, uint8_t **angles, uint8_t **scores, uint8_t **mask) {
+   *angles = planes.angles.data();
+   *scores = planes.scores.data();
+   *mask = planes.mask.data();
+}
+
+extern "C"
+void run_mdd_drt_planes_context(void *context, uint8_t *input_data, int width, int height,
+                                double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                                double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold,
+                                uint8_t **angles, uint8_t **scores, uint8_t **mask) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto &planes = static_cast<MDDDRT::Context *>(context)->run_planes(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0,
+                                                                      w_new_3, w_new_2, w_new_1, w_new_0, threshold);
+   plane_pointers(planes, angles, scores, mask);
+}
+
+extern "C"
+void run_ps_drt_planes_context(void *context, uint8_t *input_data, int width, int height,
+                               uint8_t **angles, uint8_t **scores, uint8_t **mask) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   plane_pointers(static_cast<PSDRT::Context *>(context)->run_planes(input), angles, scores, mask);
+}
+
+extern "C"
+void run_pdrt2_planes_context(void *context, uint8_t *input_data, int width, int height,
+                              uint8_t **angles, uint8_t **scores, uint8_t **mask) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   plane_pointers(static_cast<PDRT2::Context *>(context)->run_planes(input), angles, scores, mask);
+}
+
+extern "C"
+void run_pdrt32_planes_context(void *context, uint8_t *input_data, int width, int height,
+                               uint8_t **angles, uint8_t **scores, uint8_t **mask) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   plane_pointers(static_cast<PDRT32::Context *>(context)->run_planes(input), angles, scores, mask);
+}
+
+extern "C"
+void run_partial_drt_planes_context(void *context, uint8_t *input_data, int width, int height,
+                                    uint8_t **angles, uint8_t **scores, uint8_t **mask) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   plane_pointers(static_cast<PartialDRT::Context *>(context)->run_planes(input), angles, scores, mask);
+}
+
+// Structured output: each call writes at most max_detections Detections::Detection records (plain ints and floats,
+// see common/detections.h) to `detections` and returns the number of regions found
+static int copy_detections(const std::vector<Detections::Detection> &found, Detections::Detection *detections,
+                           int max_detections) {
+   int n = std::min((int) found.size(), max_detections);
+   std::copy(found.begin(), found.begin() + n, detections);
+   return (int) found.size();
+}
+
+extern "C"
+int detect_mdd_drt_context(void *context, uint8_t *input_data, int width, int height,
+                           double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                           double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold,
+                           int min_area, Detections::Detection *detections, int max_detections) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto &found = static_cast<MDDDRT::Context *>(context)->detect(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0,
+                                                                 w_new_3, w_new_2, w_new_1, w_new_0, threshold,
+                                                                 min_area);
+   return copy_detections(found, detections, max_detections);
+}
+
+extern "C"
+int detect_ps_drt_context(void *context, uint8_t *input_data, int width, int height, int min_area,
+                          Detections::Detection *detections, int max_detections) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto &found = static_cast<PSDRT::Context *>(context)->detect(input, min_area);
+   return copy_detections(found, detections, max_detections);
+}
+
+extern "C"
+int detect_pdrt2_context(void *context, uint8_t *input_data, int width, int height, int min_area,
+                         Detections::Detection *detections, int max_detections) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto &found = static_cast<PDRT2::Context *>(context)->detect(input, min_area);
+   return copy_detections(found, detections, max_detections);
+}
+
+extern "C"
+int detect_pdrt32_context(void *context, uint8_t *input_data, int width, int height, int min_area,
+                          Detections::Detection *detections, int max_detections) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto &found = static_cast<PDRT32::Context *>(context)->detect(input, min_area);
+   return copy_detections(found, detections, max_detections);
+}
+
+extern "C"
+int detect_partial_drt_context(void *context, uint8_t *input_data, int width, int height, int min_area,
+                               Detections::Detection *detections, int max_detections) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto &found = static_cast<PartialDRT::Context *>(context)->detect(input, min_area);
+   return copy_detections(found, detections, max_detections);
+}
+
+// Camera frames, read in place: `frame_data` holds a frame of the given FrameFormat::PixelFormat, whose rows are
+// row_stride bytes apart. The detectors read its luma through the strides, padded rows and packed chroma are
+// skipped without a copy. nullptr (or -1 for detect) for unknown formats
+extern "C"
+uint8_t *run_mdd_drt_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                   int format, double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                                   double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return nullptr;
+   auto output_image = static_cast<MDDDRT::Context *>(context)->run(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0,
+                                                                    w_new_3, w_new_2, w_new_1, w_new_0, threshold);
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_mdd_fused_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                     int format, double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                                     double w_new_3, double w_new_2, double w_new_1, double w_new_0,
+                                     double threshold) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return nullptr;
+   auto output_image = static_cast<MDDFused::Context *>(context)->run(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0,
+                                                                      w_new_3, w_new_2, w_new_1, w_new_0, threshold);
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_ps_drt_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                  int format) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return nullptr;
+   auto output_image = static_cast<PSDRT::Context *>(context)->run(input);
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_pdrt2_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                 int format) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return nullptr;
+   auto output_image = static_cast<PDRT2::Context *>(context)->run(input);
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_pdrt32_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                  int format) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return nullptr;
+   auto output_image = static_cast<PDRT32::Context *>(context)->run(input);
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_partial_drt_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                       int format) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return nullptr;
+   auto output_image = static_cast<PartialDRT::Context *>(context)->run(input);
+   return output_image.data();
+}
+
+extern "C"
+int detect_mdd_drt_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                 int format, double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                                 double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold,
+                                 int min_area, Detections::Detection *detections, int max_detections) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return -1;
+   auto &found = static_cast<MDDDRT::Context *>(context)->detect(input, w_orig_3, w_orig_2, w_orig_1, w_orig_0,
+                                                                 w_new_3, w_new_2, w_new_1, w_new_0, threshold,
+                                                                 min_area);
+   return copy_detections(found, detections, max_detections);
+}
+
+extern "C"
+int detect_ps_drt_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                int format, int min_area, Detections::Detection *detections, int max_detections) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return -1;
+   auto &found = static_cast<PSDRT::Context *>(context)->detect(input, min_area);
+   return copy_detections(found, detections, max_detections);
+}
+
+extern "C"
+int detect_pdrt2_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                               int format, int min_area, Detections::Detection *detections, int max_detections) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return -1;
+   auto &found = static_cast<PDRT2::Context *>(context)->detect(input, min_area);
+   return copy_detections(found, detections, max_detections);
+}
+
+extern "C"
+int detect_pdrt32_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                int format, int min_area, Detections::Detection *detections, int max_detections) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return -1;
+   auto &found = static_cast<PDRT32::Context *>(context)->detect(input, min_area);
+   return copy_detections(found, detections, max_detections);
+}
+
+extern "C"
+int detect_partial_drt_frame_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                     int format, int min_area, Detections::Detection *detections,
+                                     int max_detections) {
+   Halide::Runtime::Buffer<uint8_t> input = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!input.data())
+      return -1;
+   auto &found = static_cast<PartialDRT::Context *>(context)->detect(input, min_area);
+   return copy_detections(found, detections, max_detections);
+}
+
+// Raw camera frames: resamples the luma of a `format` frame (as for run_*_frame_context) to a working_width x
+// working_height image and stretches its contrast to 0..255, in one stage. The returned image is owned by the
+// context and overwritten by its next call, any run_*_context or run_*_sized entry point takes it as is
+extern "C"
+void *preprocess_context_create() {
+   return new Preprocess::Context();
+}
+
+extern "C"
+void preprocess_context_destroy(void *context) {
+   delete static_cast<Preprocess::Context *>(context);
+}
+
+extern "C"
+uint8_t *run_preprocess_context(void *context, uint8_t *frame_data, int width, int height, int row_stride,
+                                int format, int working_width, int working_height) {
+   Halide::Runtime::Buffer<uint8_t> frame = FrameFormat::luma(frame_data, width, height, row_stride, format);
+   if (!frame.data())
+      return nullptr;
+   return static_cast<Preprocess::Context *>(context)->run(frame, working_width, working_height).data();
+}
+
+// Regions of interest: `rois` holds n_rois (x, y, width, height) quadruples of ints, in input pixels
+static std::vector<ROI::Rect> roi_rects(const int *rois, int n_rois) {
+   std::vector<ROI::Rect> rects(n_rois);
+   for (int i = 0; i < n_rois; i++)
+      rects[i] = {rois[4 * i], rois[4 * i + 1], rois[4 * i + 2], rois[4 * i + 3]};
+   return rects;
+}
+
+extern "C"
+uint8_t *run_mdd_drt_roi_context(void *context, uint8_t *input_data, int width, int height, const int *rois,
+                                 int n_rois, double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                                 double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<MDDDRT::Context *>(context)->run_roi(input, roi_rects(rois, n_rois), w_orig_3,
+                                                                        w_orig_2, w_orig_1, w_orig_0, w_new_3,
+                                                                        w_new_2, w_new_1, w_new_0, threshold);
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_ps_drt_roi_context(void *context, uint8_t *input_data, int width, int height, const int *rois,
+                                int n_rois) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<PSDRT::Context *>(context)->run_roi(input, roi_rects(rois, n_rois));
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_pdrt2_roi_context(void *context, uint8_t *input_data, int width, int height, const int *rois,
+                               int n_rois) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<PDRT2::Context *>(context)->run_roi(input, roi_rects(rois, n_rois));
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_pdrt32_roi_context(void *context, uint8_t *input_data, int width, int height, const int *rois,
+                                int n_rois) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<PDRT32::Context *>(context)->run_roi(input, roi_rects(rois, n_rois));
+   return output_image.data();
+}
+
+// Coarse-to-fine detection: PDRT 32 screening, then PS DRT or MDD DRT refinement of the candidate tiles
+extern "C"
+void *cascade_context_create() {
+   return new Cascade::Context();
+}
+
+extern "C"
+void cascade_context_destroy(void *context) {
+   delete static_cast<Cascade::Context *>(context);
+}
+
+extern "C"
+uint8_t *run_cascade_ps_context(void *context, uint8_t *input_data, int width, int height, float coarse_score,
+                                int margin) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<Cascade::Context *>(context)->run_ps(input, coarse_score, margin);
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_cascade_mdd_context(void *context, uint8_t *input_data, int width, int height,
+                                 double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                                 double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold,
+                                 float coarse_score, int margin) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height);
+   auto output_image = static_cast<Cascade::Context *>(context)->run_mdd(input, w_orig_3, w_orig_2, w_orig_1,
+                                                                         w_orig_0, w_new_3, w_new_2, w_new_1,
+                                                                         w_new_0, threshold, coarse_score, margin);
+   return output_image.data();
+}
+
+// Detection server for several camera streams in one process, see common/detection_server.h. n_workers threads (0 for
+// one per hardware thread) process the frames of every stream earliest deadline first
+extern "C"
+void *detection_server_create(int n_workers) {
+   return new DetectionServer::Server(n_workers);
+}
+
+extern "C"
+void detection_server_destroy(void *server) {
+   delete static_cast<DetectionServer::Server *>(server);
+}
+
+// detector: 0 for the MDD DRT, 1 for the PS DRT, 2 for PDRT 2, 3 for PDRT 32. normalization and normalization_value
+// are those of partial_drt_context_set_normalization, ignored by the MDD. Returns the index of the stream, or -1 when
+// an argument is out of range
+extern "C"
+int detection_server_add_stream(void *server, int detector, int width, int height, double deadline_ms, int depth,
+                                int min_area, int normalization, float normalization_value) {
+   if (detector < 0 || detector > 3 || normalization < 0 || normalization > (int) PartialDRT::Normalization::fixed)
+      return -1;
+   DetectionServer::StreamOptions options;
+   options.detector = (DetectionServer::Detector) detector;
+   options.width = width;
+   options.height = height;
+   options.deadline_ms = deadline_ms;
+   options.depth = depth;
+   options.min_area = min_area;
+   options.normalization = (PartialDRT::Normalization) normalization;
+   options.normalization_value = normalization_value;
+   return static_cast<DetectionServer::Server *>(server)->add_stream(options);
+}
+
+// Copies a frame of the stream, whose rows are row_stride bytes apart, and returns its sequence number, or -1
+extern "C"
+long long detection_server_submit(void *server, int stream, uint8_t *frame_data, int width, int height,
+                                  int row_stride) {
+   Halide::Runtime::Buffer<uint8_t> frame = FrameFormat::strided_luma(frame_data, width, height, row_stride);
+   return static_cast<DetectionServer::Server *>(server)->submit(stream, frame);
+}
+
+// Detections of the newest processed frame of the stream, as detect_*_context, and its sequence number. Returns -1
+// when no frame of the stream is processed yet
+extern "C"
+int detection_server_latest(void *server, int stream, Detections::Detection *detections, int max_detections,
+                            long long *sequence) {
+   std::vector<Detections::Detection> found;
+   int64_t found_sequence;
+   if (!static_cast<DetectionServer::Server *>(server)->latest(stream, found, found_sequence))
+      return -1;
+   *sequence = found_sequence;
+   return copy_detections(found, detections, max_detections);
+}
+
+extern "C"
+void detection_server_drain(void *server) {
+   static_cast<DetectionServer::Server *>(server)->drain();
+}
+
+// Aggregate and per-stream throughput and latency, as text (json = 0) or JSON, copied as by instrumentation_dump
+extern "C"
+int detection_server_dump(void *server, char *buffer, int size, int json) {
+   std::string report = static_cast<DetectionServer::Server *>(server)->dump(json != 0);
+   if (size > 0) {
+      int n = std::min((int) report.size(), size - 1);
+      std::copy(report.begin(), report.begin() + n, buffer);
+      buffer[n] = 0;
+   }
+   return (int) report.size();
+}
+
+// Per-stage latency statistics, as text (json = 0) or JSON. Copies at most size - 1 characters and a terminating zero
+// to `buffer` and returns the full length, so a caller can retry with a larger buffer
+extern "C"
+int instrumentation_dump(char *buffer, int size, int json) {
+   std::string report = Instrumentation::dump(json != 0);
+   if (size > 0) {
+      int n = std::min((int) report.size(), size - 1);
+      std::copy(report.begin(), report.begin() + n, buffer);
+      buffer[n] = 0;
+   }
+   return (int) report.size();
+}
+
+extern "C"
+void instrumentation_reset() {
+   Instrumentation::reset();
+}
+
+// Feature level the stages run at: "avx512", "avx2" or "sse41", or "host" for a build targeting the build machine
+// only
+extern "C"
+const char *cpu_variant() {
+   return CpuDispatch::name(CpuDispatch::selected());
+}
+
+// Work-stealing pool running the parallel loops of every pipeline in place of Halide's own thread pool, see
+// common/thread_pool.h: n_threads threads (0 for one per hardware thread) counting the calling one, the workers pinned
+// in turn to the n_cpus CPUs of `cpus` (none when n_cpus is 0) and running at the `priority` nice value. Returns -1
+// when an argument is out of range. Not while a pipeline runs
+extern "C"
+int thread_pool_install(int n_threads, const int *cpus, int n_cpus, int priority) {
+   ThreadPool::Options options;
+   options.n_threads = n_threads;
+   options.cpus.assign(cpus, cpus + std::max(n_cpus, 0));
+   options.priority = priority;
+   return ThreadPool::install(options) ? 0 : -1;
+}
+
+extern "C"
+void thread_pool_uninstall() {
+   ThreadPool::uninstall();
+}
+
+extern "C"
+int thread_pool_threads() {
+   return ThreadPool::n_threads();
+}
+
+// Runs body(user_data, i) for i in [begin, end) on the same threads as the detectors
+extern "C"
+void thread_pool_parallel_for(int begin, int end, void (*body)(void *user_data, int i), void *user_data) {
+   ThreadPool::parallel_for(begin, end, [&](int i) { body(user_data, i); });
+}
+
+#ifdef WITH_BATCH
+// Batched entry points, input_data holds `frames` consecutive width x height images
+extern "C"
+uint8_t *run_mdd_drt_batch(void *context, uint8_t *input_data, int width, int height, int frames,
+                           double w_orig_3, double w_orig_2, double w_orig_1, double w_orig_0,
+                           double w_new_3, double w_new_2, double w_new_1, double w_new_0, double threshold) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height, frames);
+   auto output_image = static_cast<MDDDRT::Context *>(context)->run_batch(input, w_orig_3, w_orig_2, w_orig_1,
+                                                                          w_orig_0, w_new_3, w_new_2, w_new_1,
+                                                                          w_new_0, threshold);
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_ps_drt_batch(void *context, uint8_t *input_data, int width, int height, int frames) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height, frames);
+   auto output_image = static_cast<PSDRT::Context *>(context)->run_batch(input);
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_pdrt2_batch(void *context, uint8_t *input_data, int width, int height, int frames) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height, frames);
+   auto output_image = static_cast<PDRT2::Context *>(context)->run_batch(input);
+   return output_image.data();
+}
+
+extern "C"
+uint8_t *run_pdrt32_batch(void *context, uint8_t *input_data, int width, int height, int frames) {
+   Halide::Runtime::Buffer<uint8_t> input(input_data, width, height, frames);
+   auto output_image = static_cast<PDRT32::Context *>(context)->run_batch(input);
+   return output_image.data();
+}
+#endif
@@ -0,0 +1,440 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "halide_image_io.h"
+#include "mdd_drt_v.h"
+#include "mdd_drt_h.h"
+#include "mdd_bar_detector_0.h"
+#include "mdd_bar_detector_1.h"
+#include "mdd_bar_detector_2.h"
+#include "mdd_bar_detector_3.h"
+#include "mdd_bar_detector_4.h"
+#include "unpool_0.h"
+#include "unpool_1.h"
+#include "unpool_2.h"
+#include "unpool_3.h"
+#include "convolutions_0.h"
+#include "convolutions_1.h"
+#include "convolutions_2.h"
+#include "convolutions_3.h"
+#include "unpool_convolutions_0.h"
+#include "unpool_convolutions_1.h"
+#include "unpool_convolutions_2.h"
+#include "unpool_convolutions_3.h"
+#include "argmaxth.h"
+#include "../common/image_utils.h"
+#include "../common/drt_geometry.h"
+#include "../common/cpu_dispatch.h"
+#include "../common/thread_pool.h"
+#include "../common/partial_drt_registry.h"
+
+// Times every AOT stage of the MDD DRT and of each partial strided DRT operating point on each image of a directory
+// and on synthetic frames, in pipeline order so that each stage finds its inputs where a real run leaves them.
+// Reports of a build with manual schedules and of one with the autoscheduler can be compared stage by stage. The MDD
+// DRT is timed with both decoders, unpool and convolutions ("mdd") and unpool_convolutions ("mdd_sparse").
+// With --scaling, every detector then runs on the 1024x1024 synthetic frame on ThreadPool pools of 1, 2, 4... threads
+// up to the hardware threads, and on Halide's own pool for reference.
+// Usage: barcode_segmentation_benchmark [--images <dir>] [--samples <n>] [--json <file>] [--scaling]
+
+using Halide::Runtime::Buffer;
+
+namespace {
+
+// Weights and threshold used by python/camera.py, indexed by decoder stage: camera.py and MDDDRT::Context list them
+// from stage 3 down to stage 0
+const double w_orig[4] = {0.76, 0.33, 0.527, 0.05};
+const double w_new[4] = {3.47, 1.16, 0.84, 0.84};
+const double mdd_threshold = 1;
+
+// Schedules the stage libraries were built with, see BARCODE_SEGMENTATION_MANUAL_SCHEDULES
+#ifdef WITH_MANUAL_SCHEDULES
+const char *schedule = "manual";
+#else
+const char *schedule = "auto";
+#endif
+
+Buffer<uint8_t> jetr(ImageUtils::jet_r);
+Buffer<uint8_t> jetg(ImageUtils::jet_g);
+Buffer<uint8_t> jetb(ImageUtils::jet_b);
+
+struct Stage {
+   std::string name;
+   std::function<void()> run;
+   // Sizes of the buffers read and written by one call
+   size_t bytes;
+   // Wall time of each call, in milliseconds
+   std::vector<double> samples;
+};
+
+struct Pipeline {
+   std::string detector;
+   // The vertical DRT comes first and the horizontal one second
+   std::vector<Stage> stages;
+   // Buffers of the stages, kept alive with the pipeline
+   std::shared_ptr<void> buffers;
+};
+
+template<typename... B>
+size_t bytes_of(const B &... buffers) {
+   return (buffers.size_in_bytes() + ...);
+}
+
+struct MDDBuffers {
+   Buffer<int16_t> drt_v[5], drt_h[5], encoder[5];
+   Buffer<int16_t> unpool[4], convolutions[4];
+   Buffer<uint8_t> output;
+};
+
+typedef int (*UnpoolConvolutionsStage)(halide_buffer_t *, halide_buffer_t *, float, float, halide_buffer_t *);
+
+// With sparse_unpool, the decoder runs the unpool_convolutions stages instead of unpool and convolutions, as
+// MDDDRT::Context does when built with BARCODE_SEGMENTATION_SPARSE_UNPOOL
+Pipeline mdd_pipeline(Buffer<uint8_t> &frames, bool sparse_unpool) {
+   int width = frames.dim(0).extent(), height = frames.dim(1).extent();
+   auto n_squares = [](int n, int stage) { return DRTGeometry::n_squares(n, 32, 32, stage); };
+   auto b = std::make_shared<MDDBuffers>();
+   for (int i = 0; i < 5; i++) {
+      int stage = i + 1;
+      int n_slopes = DRTGeometry::n_slopes(stage);
+      b->drt_v[i] = Buffer<int16_t>(width, n_slopes, n_squares(height, stage), 1);
+      b->drt_h[i] = Buffer<int16_t>(height, n_slopes, n_squares(width, stage), 1);
+      b->encoder[i] = Buffer<int16_t>(2 * n_slopes, n_squares(width, stage), n_squares(height, stage), 1);
+   }
+   for (int i = 0; i < 4; i++) {
+      int channels = i == 3 ? 62 : 30;
+      if (!sparse_unpool)
+         b->unpool[i] = Buffer<int16_t>(channels, n_squares(width, i + 1), n_squares(height, i + 1), 1);
+      b->convolutions[i] = Buffer<int16_t>(channels, n_squares(width, i + 1), n_squares(height, i + 1), 1);
+   }
+   b->output = Buffer<uint8_t>(n_squares(width, 1), n_squares(height, 1), 3, 1);
+
+   Pipeline pipeline{sparse_unpool ? "mdd_sparse" : "mdd", {}, b};
+   MDDBuffers &m = *b;
+   pipeline.stages.push_back({"mdd_drt_v", [&m, &frames]() {
+      mdd_drt_v(frames, m.drt_v[0], m.drt_v[1], m.drt_v[2], m.drt_v[3], m.drt_v[4]);
+   }, bytes_of(frames, m.drt_v[0], m.drt_v[1], m.drt_v[2], m.drt_v[3], m.drt_v[4])});
+   pipeline.stages.push_back({"mdd_drt_h", [&m, &frames]() {
+      mdd_drt_h(frames, m.drt_h[0], m.drt_h[1], m.drt_h[2], m.drt_h[3], m.drt_h[4]);
+   }, bytes_of(frames, m.drt_h[0], m.drt_h[1], m.drt_h[2], m.drt_h[3], m.drt_h[4])});
+   int (*bar_detectors[5])(halide_buffer_t *, halide_buffer_t *, halide_buffer_t *) = {
+      mdd_bar_detector_0, mdd_bar_detector_1, mdd_bar_detector_2, mdd_bar_detector_3, mdd_bar_detector_4};
+   for (int i = 0; i < 5; i++)
+      pipeline.stages.push_back({"mdd_bar_detector_" + std::to_string(i), [&m, i, bar_detectors]() {
+         bar_detectors[i](m.drt_h[i], m.drt_v[i], m.encoder[i]);
+      }, bytes_of(m.drt_h[i], m.drt_v[i], m.encoder[i])});
+   // The decoder goes from the coarsest stage to the finest one
+   if (sparse_unpool) {
+      UnpoolConvolutionsStage decoder[4] = {unpool_convolutions_0, unpool_convolutions_1, unpool_convolutions_2,
+                                            unpool_convolutions_3};
+      for (int i = 3; i >= 0; i--) {
+         pipeline.stages.push_back({"unpool_convolutions_" + std::to_string(i), [&m, i, decoder]() {
+            Buffer<int16_t> &coarse = i == 3 ? m.encoder[4] : m.convolutions[i + 1];
+            decoder[i](coarse, m.encoder[i], w_new[i], w_orig[i], m.convolutions[i]);
+         }, bytes_of(i == 3 ? m.encoder[4] : m.convolutions[i + 1], m.encoder[i], m.convolutions[i])});
+      }
+   } else {
+      pipeline.stages.push_back({"unpool_3", [&m]() {
+         unpool_3(m.encoder[4], m.encoder[3], w_new[3], w_orig[3], m.unpool[3]);
+      }, bytes_of(m.encoder[4], m.encoder[3], m.unpool[3])});
+      pipeline.stages.push_back({"convolutions_3", [&m]() {
+         convolutions_3(m.unpool[3], m.convolutions[3]);
+      }, bytes_of(m.unpool[3], m.convolutions[3])});
+      pipeline.stages.push_back({"unpool_2", [&m]() {
+         unpool_2(m.convolutions[3], m.encoder[2], w_new[2], w_orig[2], m.unpool[2]);
+      }, bytes_of(m.convolutions[3], m.encoder[2], m.unpool[2])});
+      pipeline.stages.push_back({"convolutions_2", [&m]() {
+         convolutions_2(m.unpool[2], m.convolutions[2]);
+      }, bytes_of(m.unpool[2], m.convolutions[2])});
+      pipeline.stages.push_back({"unpool_1", [&m]() {
+         unpool_1(m.convolutions[2], m.encoder[1], w_new[1], w_orig[1], m.unpool[1]);
+      }, bytes_of(m.convolutions[2], m.encoder[1], m.unpool[1])});
+      pipeline.stages.push_back({"convolutions_1", [&m]() {
+         convolutions_1(m.unpool[1], m.convolutions[1]);
+      }, bytes_of(m.unpool[1], m.convolutions[1])});
+      pipeline.stages.push_back({"unpool_0", [&m]() {
+         unpool_0(m.convolutions[1], m.encoder[0], w_new[0], w_orig[0], m.unpool[0]);
+      }, bytes_of(m.convolutions[1], m.encoder[0], m.unpool[0])});
+      pipeline.stages.push_back({"convolutions_0", [&m]() {
+         convolutions_0(m.unpool[0], m.convolutions[0]);
+      }, bytes_of(m.unpool[0], m.convolutions[0])});
+   }
+   pipeline.stages.push_back({"argmaxth", [&m]() {
+      argmaxth(m.convolutions[0], jetr, jetg, jetb, mdd_threshold, m.output);
+   }, bytes_of(m.convolutions[0], m.output)});
+   return pipeline;
+}
+
+// Buffers of the detectors with a single square grid: every partial strided DRT operating point
+struct GridBuffers {
+   Buffer<int16_t> drt_v, drt_h, intensities, slopes, peak;
+   Buffer<uint8_t> output, angles, scores, mask;
+};
+
+typedef int (*DRTStage)(halide_buffer_t *, halide_buffer_t *);
+typedef int (*BarDetectorStage)(halide_buffer_t *, halide_buffer_t *, halide_buffer_t *, halide_buffer_t *);
+typedef int (*ThresholdJetStage)(halide_buffer_t *, halide_buffer_t *, halide_buffer_t *, halide_buffer_t *,
+                                 halide_buffer_t *, halide_buffer_t *);
+typedef int (*BarThresholdStage)(halide_buffer_t *, halide_buffer_t *, float, halide_buffer_t *, halide_buffer_t *,
+                                 halide_buffer_t *, halide_buffer_t *);
+
+Pipeline grid_pipeline(Buffer<uint8_t> &frames, const std::string &detector, int tile_size, int stride,
+                       int last_stage, DRTStage drt_v, DRTStage drt_h, BarDetectorStage bar_detector,
+                       ThresholdJetStage threshold_jet, BarThresholdStage bar_threshold) {
+   int width = frames.dim(0).extent(), height = frames.dim(1).extent();
+   int n_squares_x = DRTGeometry::n_squares(width, tile_size, stride, last_stage);
+   int n_squares_y = DRTGeometry::n_squares(height, tile_size, stride, last_stage);
+   int n_slopes = DRTGeometry::n_slopes(last_stage);
+   auto b = std::make_shared<GridBuffers>();
+   b->drt_v = Buffer<int16_t>(width, n_slopes, n_squares_y, 1);
+   b->drt_h = Buffer<int16_t>(height, n_slopes, n_squares_x, 1);
+   b->intensities = Buffer<int16_t>(n_squares_x, n_squares_y, 1);
+   b->slopes = Buffer<int16_t>(n_squares_x, n_squares_y, 1);
+   b->output = Buffer<uint8_t>(n_squares_x, n_squares_y, 3, 1);
+   b->angles = Buffer<uint8_t>(n_squares_x, n_squares_y, 1);
+   b->scores = Buffer<uint8_t>(n_squares_x, n_squares_y, 1);
+   b->mask = Buffer<uint8_t>((n_squares_x + 7) / 8, n_squares_y, 1);
+   b->peak = Buffer<int16_t>(1);
+   b->peak.fill(0);
+
+   Pipeline pipeline{detector, {}, b};
+   GridBuffers &g = *b;
+   std::string prefix = detector == "ps" ? "ps_drt" : detector;
+   pipeline.stages.push_back({prefix + "_v", [&g, &frames, drt_v]() { drt_v(frames, g.drt_v); },
+                              bytes_of(frames, g.drt_v)});
+   pipeline.stages.push_back({prefix + "_h", [&g, &frames, drt_h]() { drt_h(frames, g.drt_h); },
+                              bytes_of(frames, g.drt_h)});
+   pipeline.stages.push_back({detector + "_bar_detector", [&g, bar_detector]() {
+      bar_detector(g.drt_h, g.drt_v, g.intensities, g.slopes);
+   }, bytes_of(g.drt_h, g.drt_v, g.intensities, g.slopes)});
+   pipeline.stages.push_back({detector + "_threshold_jet", [&g, threshold_jet]() {
+      threshold_jet(g.intensities, g.slopes, jetr, jetg, jetb, g.output);
+   }, bytes_of(g.intensities, g.slopes, g.output)});
+   // Single-pass alternative to the two stages above, normalized by the strongest square of the previous frame
+   pipeline.stages.push_back({detector + "_bar_threshold", [&g, bar_threshold]() {
+      bar_threshold(g.drt_h, g.drt_v, std::max<float>(g.peak(0), 1), g.angles, g.scores, g.mask, g.peak);
+   }, bytes_of(g.drt_h, g.drt_v, g.angles, g.scores, g.mask)});
+   return pipeline;
+}
+
+// Nearest rank percentile of sorted samples
+double percentile(const std::vector<double> &sorted, double p) {
+   size_t rank = (size_t) std::ceil(p * sorted.size());
+   return sorted[std::min(std::max(rank, (size_t) 1), sorted.size()) - 1];
+}
+
+// Median wall time of the whole pipeline, stage after stage, in milliseconds
+double pipeline_median(Pipeline &pipeline, int n_samples) {
+   for (Stage &stage: pipeline.stages)
+      stage.run();
+   std::vector<double> samples;
+   for (int sample = 0; sample < n_samples; sample++) {
+      auto start = std::chrono::steady_clock::now();
+      for (Stage &stage: pipeline.stages)
+         stage.run();
+      auto end = std::chrono::steady_clock::now();
+      samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+   }
+   std::sort(samples.begin(), samples.end());
+   return percentile(samples, 0.5);
+}
+
+// Deterministic frame with bars of a few orientations over noise
+Buffer<uint8_t> synthetic_image(int width, int height) {
+   Buffer<uint8_t> image(width, height);
+   uint32_t state = 12345;
+   for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+         state = state * 1664525u + 1013904223u;
+         int noise = (int) (state >> 27);
+         int region = (x * 4 / width) + 4 * (y * 4 / height);
+         int bar = region % 3 == 0 ? x / 3 : region % 3 == 1 ? (x + y) / 4 : y / 5;
+         image(x, y) = (uint8_t) ((bar % 2 ? 200 : 40) + noise);
+      }
+   }
+   return image;
+}
+
+// Gray level of an image file, its first channel for color files
+Buffer<uint8_t> load_gray(const std::string &path) {
+   Buffer<uint8_t> image = Halide::Tools::load_image(path);
+   Buffer<uint8_t> gray(image.width(), image.height());
+   gray.copy_from(image.dimensions() > 2 ? image.sliced(2, 0) : image);
+   return gray;
+}
+
+std::string json_escape(const std::string &text) {
+   std::string escaped;
+   for (char c: text) {
+      if (c == '"' || c == '\\')
+         escaped += '\\';
+      escaped += c;
+   }
+   return escaped;
+}
+
+}
+
+int main(int argc, char **argv) {
+   std::string images_dir = EXAMPLES_DIR;
+   std::string json_path = std::string(OUTPUT_DIR) + "benchmark.json";
+   int n_samples = 50;
+   bool scaling = false;
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "--images") && i + 1 < argc) {
+         images_dir = argv[++i];
+      } else if (!strcmp(argv[i], "--samples") && i + 1 < argc) {
+         n_samples = std::max(1, atoi(argv[++i]));
+      } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+         json_path = argv[++i];
+      } else if (!strcmp(argv[i], "--scaling")) {
+         scaling = true;
+      } else {
+         std::cerr << "Unknown argument " << argv[i] << std::endl;
+         return 1;
+      }
+   }
+
+   std::vector<std::pair<std::string, Buffer<uint8_t>>> images;
+   std::vector<std::string> paths;
+   for (const auto &entry: std::filesystem::directory_iterator(images_dir)) {
+      std::string extension = entry.path().extension().string();
+      if (extension == ".jpg" || extension == ".png")
+         paths.push_back(entry.path().string());
+   }
+   std::sort(paths.begin(), paths.end());
+   for (const std::string &path: paths)
+      images.emplace_back(std::filesystem::path(path).filename().string(), load_gray(path));
+   for (auto size: std::vector<std::pair<int, int>>{{512, 512}, {1024, 1024}, {1920, 1080}})
+      images.emplace_back("synthetic_" + std::to_string(size.first) + "x" + std::to_string(size.second),
+                          synthetic_image(size.first, size.second));
+
+   std::ostringstream json;
+   json << std::fixed << std::setprecision(4);
+   const char *variant = CpuDispatch::name(CpuDispatch::selected());
+   std::cout << "Schedules: " << schedule << ", CPU variant: " << variant << std::endl;
+   json << "{\n  \"schedule\": \"" << schedule << "\",\n  \"cpu_variant\": \"" << variant
+        << "\",\n  \"samples\": " << n_samples << ",\n  \"runs\": [";
+   bool first_run = true;
+   for (auto &named_image: images) {
+      // The pipelines work on stacks of frames, a single image is a stack of one
+      Buffer<uint8_t> frames = named_image.second.embedded(2);
+      std::vector<Pipeline> pipelines;
+      pipelines.push_back(mdd_pipeline(frames, false));
+      pipelines.push_back(mdd_pipeline(frames, true));
+      for (const PartialDRT::OperatingPoint &point: PartialDRT::operating_points())
+         pipelines.push_back(grid_pipeline(frames, point.name, point.tile_size, point.stride, point.last_stage(),
+                                           point.drt_v, point.drt_h, point.bar_detector, point.threshold_jet,
+                                           point.bar_threshold));
+      for (Pipeline &pipeline: pipelines) {
+         // One warm-up run, then every sample runs the stages in order
+         for (Stage &stage: pipeline.stages)
+            stage.run();
+         for (int sample = 0; sample < n_samples; sample++) {
+            for (Stage &stage: pipeline.stages) {
+               auto start = std::chrono::steady_clock::now();
+               stage.run();
+               auto end = std::chrono::steady_clock::now();
+               stage.samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            }
+         }
+
+         std::cout << named_image.first << " (" << frames.dim(0).extent() << "x" << frames.dim(1).extent() << ") "
+                   << pipeline.detector << std::endl;
+         json << (first_run ? "" : ",") << "\n    {\"image\": \"" << json_escape(named_image.first)
+              << "\", \"width\": " << frames.dim(0).extent() << ", \"height\": " << frames.dim(1).extent()
+              << ", \"detector\": \"" << pipeline.detector << "\", \"stages\": [";
+         first_run = false;
+         double total = 0;
+         for (size_t s = 0; s < pipeline.stages.size(); s++) {
+            Stage &stage = pipeline.stages[s];
+            std::sort(stage.samples.begin(), stage.samples.end());
+            double median = percentile(stage.samples, 0.5);
+            total += median;
+            std::cout << "  " << std::left << std::setw(22) << stage.name << std::right << std::fixed
+                      << std::setprecision(3) << " min " << std::setw(8) << stage.samples.front()
+                      << " ms  median " << std::setw(8) << median
+                      << " ms  p95 " << std::setw(8) << percentile(stage.samples, 0.95)
+                      << " ms  p99 " << std::setw(8) << percentile(stage.samples, 0.99)
+                      << " ms  " << std::setw(8) << stage.bytes / 1024 << " KiB" << std::endl;
+            json << (s ? "," : "") << "\n      {\"name\": \"" << stage.name << "\", \"min_ms\": "
+                 << stage.samples.front() << ", \"median_ms\": " << median
+                 << ", \"p95_ms\": " << percentile(stage.samples, 0.95)
+                 << ", \"p99_ms\": " << percentile(stage.samples, 0.99)
+                 << ", \"bytes\": " << stage.bytes << "}";
+         }
+         // With the manual schedules, the horizontal DRT reads the columns of the frame through its blocked
+         // transpose and should cost as much as the vertical one. The autoscheduler schedules the transpose itself
+         double h_over_v = percentile(pipeline.stages[1].samples, 0.5) / percentile(pipeline.stages[0].samples, 0.5);
+         json << "\n    ], \"drt_h_over_v\": " << h_over_v << "}";
+         std::cout << "  total (sum of medians) " << total << " ms, horizontal/vertical DRT " << h_over_v
+                   << std::endl;
+      }
+   }
+   json << "\n  ]";
+
+   if (scaling) {
+      int max_threads = std::max(1, (int) std::thread::hardware_concurrency());
+      std::vector<int> thread_counts;
+      for (int n = 1; n < max_threads; n *= 2)
+         thread_counts.push_back(n);
+      thread_counts.push_back(max_threads);
+      Buffer<uint8_t> image = synthetic_image(1024, 1024);
+      Buffer<uint8_t> frames = image.embedded(2);
+      std::vector<Pipeline> pipelines;
+      pipelines.push_back(mdd_pipeline(frames, false));
+      pipelines.push_back(mdd_pipeline(frames, true));
+      for (const PartialDRT::OperatingPoint &point: PartialDRT::operating_points())
+         pipelines.push_back(grid_pipeline(frames, point.name, point.tile_size, point.stride, point.last_stage(),
+                                           point.drt_v, point.drt_h, point.bar_detector, point.threshold_jet,
+                                           point.bar_threshold));
+      json << ",\n  \"scaling\": [";
+      bool first_point = true;
+      for (Pipeline &pipeline: pipelines) {
+         ThreadPool::uninstall();
+         double halide_pool = pipeline_median(pipeline, n_samples);
+         std::cout << "synthetic_1024x1024 " << pipeline.detector << " scaling, Halide pool " << std::fixed
+                   << std::setprecision(3) << halide_pool << " ms" << std::endl;
+         double single = 0;
+         for (int n_threads: thread_counts) {
+            ThreadPool::Options options;
+            options.n_threads = n_threads;
+            ThreadPool::install(options);
+            double median = pipeline_median(pipeline, n_samples);
+            if (n_threads == 1)
+               single = median;
+            std::cout << "  " << std::setw(3) << n_threads << " threads " << std::setw(8) << median
+                      << " ms  speedup " << std::setprecision(2) << single / median << std::setprecision(3)
+                      << std::endl;
+            json << (first_point ? "" : ",") << "\n    {\"detector\": \"" << pipeline.detector
+                 << "\", \"threads\": " << n_threads << ", \"median_ms\": " << median
+                 << ", \"speedup\": " << single / median << ", \"halide_pool_ms\": " << halide_pool << "}";
+            first_point = false;
+         }
+      }
+      ThreadPool::uninstall();
+      json << "\n  ]";
+   }
+   json << "\n}\n";
+
+   std::ofstream file(json_path);
+   if (!file) {
+      std::cerr << "Cannot write " << json_path << std::endl;
+      return 1;
+   }
+   file << json.str();
+   std::cout << "Wrote " << json_path << std::endl;
+   return 0;
+}
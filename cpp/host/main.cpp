@@ -1,15 +1,48 @@
+#include <algorithm>
 #include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
 
 #include "halide_benchmark.h"
 #include "halide_image_io.h"
+#include "unpool_0.h"
+#include "convolutions_0.h"
+#include "unpool_convolutions_0.h"
 #include "../common/image_utils.h"
 #include "../common/multiscale_domain_detector_drt.h"
+#include "../common/multiscale_domain_detector_fused.h"
 #include "../common/partial_strided_drt.h"
 #include "../common/partial_drt2.h"
 #include "../common/partial_drt32.h"
+#include "../common/cascade_detector.h"
+#include "../common/instrumentation.h"
+#include "../common/cpu_dispatch.h"
+#include "../common/thread_pool.h"
+#include "../common/frame_format.h"
+#include "../common/preprocess.h"
+#include "../common/partial_drt_registry.h"
+#include "../common/frame_stream.h"
+#include "../common/detection_server.h"
+#include "../common/roi.h"
 
 std::string path = std::string(INPUT_DIR) + "cluttered.jpg";
 
+// Comparisons that found different outputs, main() fails if there are any
+int n_failures = 0;
+
+// Whether the output has the shape and the values of the expected one. A difference is counted as a failure
+template<typename T>
+bool same_output(const Halide::Runtime::Buffer<T> &expected, const Halide::Runtime::Buffer<T> &output) {
+   bool same = expected.dimensions() == output.dimensions();
+   for (int d = 0; same && d < expected.dimensions(); d++)
+      same = expected.dim(d).extent() == output.dim(d).extent();
+   same = same && std::equal(expected.data(), expected.data() + expected.number_of_elements(), output.data());
+   if (!same)
+      n_failures++;
+   return same;
+}
+
 void test_mdd() {
    Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
    std::cout << "test_mdd " << path.c_str() << std::endl;
@@ -21,6 +54,118 @@ void test_mdd() {
    Halide::Tools::save_image(output_image_mdd, std::string(OUTPUT_DIR) + "output_image_mdd.png");
 }
 
+// Runs the MDD stage graph, with independent stages overlapping
+void test_mdd_graph() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_mdd_graph " << path.c_str() << std::endl;
+   MDDDRT::Context context;
+   double time_mdd = Halide::Tools::benchmark(2, 100, [&]() {
+      context.run_concurrent(input);
+   });
+   std::cout << "Time_mdd_graph: " << time_mdd * 1e3 << " ms." << std::endl;
+}
+
+// Runs the incremental MDD on a static scene, with one 64x64 patch changing between frames, and compares the output
+// with that of run() for an unchanged frame and for a frame with a local edit
+void test_mdd_incremental() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_mdd_incremental " << path.c_str() << std::endl;
+   MDDDRT::Context context;
+   Halide::Runtime::Buffer<uint8_t> frame(input.width(), input.height());
+   frame.copy_from(input);
+   int i = 0;
+   double time_mdd = Halide::Tools::benchmark(2, 100, [&]() {
+      for (int y = 0; y < std::min(64, frame.height()); y++)
+         for (int x = 0; x < std::min(64, frame.width()); x++)
+            frame(x, y) = (i & 1) ? input(x, y) : 255 - input(x, y);
+      i++;
+      context.run_incremental(frame);
+   });
+   std::cout << "Time_mdd_incremental: " << time_mdd * 1e3 << " ms." << std::endl;
+
+   // Every changed tile is recomputed with a change threshold of 0, so the output is exactly that of run()
+   MDDDRT::Context reference_context;
+   auto run_incremental = [&]() { return context.run_incremental(frame, 1, 1, 1, 1, 1, 1, 1, 1, 0.05, 0); };
+   frame.copy_from(input);
+   run_incremental();
+   bool same_unchanged = same_output(reference_context.run(frame), run_incremental());
+   // A patch off the tile grid, so the dirty tiles and their halo straddle several encoder squares
+   for (int y = frame.height() / 3; y < std::min(frame.height() / 3 + 40, frame.height()); y++)
+      for (int x = frame.width() / 2 - 20; x < std::min(frame.width() / 2 + 20, frame.width()); x++)
+         frame(x, y) = 255 - frame(x, y);
+   bool same_edited = same_output(reference_context.run(frame), run_incremental());
+   std::cout << "Incremental_mdd: unchanged frame " << (same_unchanged ? "same output" : "DIFFERENT OUTPUT")
+             << ", edited frame " << (same_edited ? "same output" : "DIFFERENT OUTPUT") << "." << std::endl;
+}
+
+// Whether the output of run_roi() is that of run() on the squares overlapping the regions and zero on the others
+bool same_in_rois(const Halide::Runtime::Buffer<uint8_t> &reference, const Halide::Runtime::Buffer<uint8_t> &output,
+                  const std::vector<ROI::Rect> &rois, int tile_size, int stride) {
+   Halide::Runtime::Buffer<uint8_t> expected(reference.width(), reference.height(), reference.channels());
+   expected.copy_from(reference);
+   ROI::zero_outside(expected, rois, tile_size, stride);
+   return same_output(expected, output);
+}
+
+// Runs the MDD and PS detectors on a horizontal band covering a quarter of the image and on a small region off the
+// square grid, and compares the outputs with those of run()
+void test_roi() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_roi " << path.c_str() << std::endl;
+   std::vector<ROI::Rect> rois = {{0, 3 * input.height() / 8, input.width(), input.height() / 4},
+                                  {input.width() / 8 + 5, input.height() / 8 + 3, 101, 67}};
+   MDDDRT::Context mdd_context, mdd_reference_context;
+   PSDRT::Context ps_context, ps_reference_context;
+   double time_mdd = Halide::Tools::benchmark(2, 100, [&]() {
+      mdd_context.run_roi(input, rois);
+   });
+   double time_ps = Halide::Tools::benchmark(2, 100, [&]() {
+      ps_context.run_roi(input, rois);
+   });
+   // The MDD output squares are those of its first stage, 2x2 pixels. The PS DRT squares are 32 pixels wide, every
+   // 2 pixels
+   bool same_mdd = same_in_rois(mdd_reference_context.run(input), mdd_context.run_roi(input, rois), rois, 2, 2);
+   bool same_ps = same_in_rois(ps_reference_context.run(input), ps_context.run_roi(input, rois), rois, 32, 2);
+   std::cout << "Time_mdd_roi: " << time_mdd * 1e3 << " ms, " << (same_mdd ? "same output" : "DIFFERENT OUTPUT")
+             << "." << std::endl;
+   std::cout << "Time_ps_roi: " << time_ps * 1e3 << " ms, " << (same_ps ? "same output" : "DIFFERENT OUTPUT") << "."
+             << std::endl;
+   Halide::Tools::save_image(mdd_context.run_roi(input, rois), std::string(OUTPUT_DIR) + "output_image_mdd_roi.png");
+}
+
+// Screens with PDRT 32 and refines the candidate tiles with the PS DRT and the MDD DRT
+void test_cascade() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_cascade " << path.c_str() << std::endl;
+   Cascade::Context context;
+   double time_ps = Halide::Tools::benchmark(2, 100, [&]() {
+      context.run_ps(input);
+   });
+   std::cout << "Time_cascade_ps: " << time_ps * 1e3 << " ms." << std::endl;
+   double time_mdd = Halide::Tools::benchmark(2, 100, [&]() {
+      context.run_mdd(input);
+   });
+   std::cout << "Time_cascade_mdd: " << time_mdd * 1e3 << " ms, " << context.candidates().size()
+             << " candidate regions." << std::endl;
+   Halide::Tools::save_image(context.run_ps(input), std::string(OUTPUT_DIR) + "output_image_cascade_ps.png");
+}
+
+// Runs the fused MDD pipeline and compares its output with that of MDDDRT::Context, stage by stage
+void test_mdd_fused() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_mdd_fused " << path.c_str() << std::endl;
+   double time_mdd = Halide::Tools::benchmark(2, 100, [&]() {
+      MDDFused::run(input);
+   });
+   MDDDRT::Context reference_context;
+   auto reference = reference_context.run(input);
+   auto output_image_mdd = MDDFused::run(input);
+   bool same = same_output(reference, output_image_mdd);
+   std::cout << "Time_mdd_fused: " << time_mdd * 1e3 << " ms, " << (same ? "same output" : "DIFFERENT OUTPUT") << "."
+             << std::endl;
+   Halide::Tools::save_image(output_image_mdd, std::string(OUTPUT_DIR) + "output_image_mdd_fused.png");
+}
+
 void test_ps() {
    Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
    std::cout << "test_ps " << path.c_str() << std::endl;
@@ -32,6 +177,101 @@ void test_ps() {
    Halide::Tools::save_image(output_image_ps, std::string(OUTPUT_DIR) + "output_image_ps.png");
 }
 
+// Runs the PS DRT on the luma of a YUYV frame with padded rows, read in place, and compares it with the gray image
+void test_frame_formats() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_frame_formats " << path.c_str() << std::endl;
+   int row_stride = 2 * input.width() + 64;
+   std::vector<uint8_t> frame(row_stride * input.height(), 128);
+   for (int y = 0; y < input.height(); y++) {
+      for (int x = 0; x < input.width(); x++)
+         frame[y * row_stride + 2 * x] = input(x, y);
+   }
+   Halide::Runtime::Buffer<uint8_t> luma = FrameFormat::luma(frame.data(), input.width(), input.height(), row_stride,
+                                                             FrameFormat::yuyv);
+   PSDRT::Context gray_context, yuyv_context;
+   double time_gray = Halide::Tools::benchmark(2, 100, [&]() {
+      gray_context.run(input);
+   });
+   double time_yuyv = Halide::Tools::benchmark(2, 100, [&]() {
+      yuyv_context.run(luma);
+   });
+   auto gray = gray_context.run(input);
+   auto yuyv = yuyv_context.run(luma);
+   bool same = same_output(gray, yuyv);
+   std::cout << "Time_ps_gray: " << time_gray * 1e3 << " ms, Time_ps_yuyv: " << time_yuyv * 1e3 << " ms, "
+             << (same ? "same output" : "DIFFERENT OUTPUT") << "." << std::endl;
+}
+
+// Writes the MDD DRT and PS DRT outputs into caller-owned buffers and compares them with those of run()
+void test_run_into() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_run_into " << path.c_str() << std::endl;
+   MDDDRT::Context mdd_context;
+   PSDRT::Context ps_context;
+   auto mdd = mdd_context.run(input);
+   auto ps = ps_context.run(input);
+   Halide::Runtime::Buffer<uint8_t> mdd_output(mdd.width(), mdd.height(), 3);
+   Halide::Runtime::Buffer<uint8_t> ps_output(ps.width(), ps.height(), 3);
+   double time_into = Halide::Tools::benchmark(2, 100, [&]() {
+      ps_context.run_into(input, ps_output);
+   });
+   mdd_context.run_into(input, mdd_output);
+   bool same = same_output(mdd, mdd_output) && same_output(ps, ps_output);
+   std::cout << "Time_ps_into: " << time_into * 1e3 << " ms, " << (same ? "same output" : "DIFFERENT OUTPUT") << "."
+             << std::endl;
+}
+
+// Runs the MDD DRT with the intermediates laid out for run(), run_concurrent() and run_incremental() in turn, and
+// compares the outputs with those of a context that only runs run()
+void test_mdd_arena() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_mdd_arena " << path.c_str() << std::endl;
+   MDDDRT::Context reference_context, context;
+   auto reference = reference_context.run(input);
+   auto check = [&](const std::string &name, const Halide::Runtime::Buffer<uint8_t> &output) {
+      bool same = same_output(reference, output);
+      std::cout << "Intermediates_mdd_" << name << ": " << context.intermediate_bytes() / 1e6 << " MB, "
+                << (same ? "same output" : "DIFFERENT OUTPUT") << "." << std::endl;
+   };
+   check("sequential", context.run(input));
+   check("concurrent", context.run_concurrent(input));
+   context.run_incremental(input);
+   check("incremental", context.run_incremental(input));
+   check("sequential", context.run(input));
+}
+
+// Runs the finest decoder stage as unpool then convolutions, and as unpool_convolutions, on random activations with
+// an odd number of fine squares, and compares the outputs
+void test_sparse_unpool() {
+   std::cout << "test_sparse_unpool" << std::endl;
+   Halide::Runtime::Buffer<int16_t> coarse(30, 32, 24, 1), fine(6, 63, 47, 1);
+   std::mt19937 generator(1);
+   std::uniform_int_distribution<int> activation(0, 1000);
+   auto random = [&]() { return (int16_t) activation(generator); };
+   std::generate(coarse.data(), coarse.data() + coarse.number_of_elements(), random);
+   std::generate(fine.data(), fine.data() + fine.number_of_elements(), random);
+   Halide::Runtime::Buffer<int16_t> unpooled(30, 63, 47, 1), dense(30, 63, 47, 1), sparse(30, 63, 47, 1);
+   unpool_0(coarse, fine, 0.84f, 0.05f, unpooled);
+   convolutions_0(unpooled, dense);
+   unpool_convolutions_0(coarse, fine, 0.84f, 0.05f, sparse);
+   bool same = same_output(dense, sparse);
+   std::cout << "Sparse_unpool: " << (same ? "same output" : "DIFFERENT OUTPUT") << "." << std::endl;
+}
+
+// Resamples the image to 1024x1024 and stretches its contrast, then runs the PS DRT on the working image
+void test_preprocess() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_preprocess " << path.c_str() << std::endl;
+   Preprocess::Context context;
+   double time_preprocess = Halide::Tools::benchmark(2, 100, [&]() {
+      context.run(input);
+   });
+   std::cout << "Time_preprocess: " << time_preprocess * 1e3 << " ms." << std::endl;
+   auto output_image_ps = PSDRT::run(context.run(input));
+   Halide::Tools::save_image(output_image_ps, std::string(OUTPUT_DIR) + "output_image_ps_preprocessed.png");
+}
+
 void test_pdrt2() {
    Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
    std::cout << "test_pdrt2 " << path.c_str() << std::endl;
@@ -55,14 +295,203 @@ void test_pdrt32() {
    Halide::Tools::save_image(output_image_ps, std::string(OUTPUT_DIR) + "output_image_pdrt32.png");
 }
 
+// Times every partial strided DRT operating point and counts its detections
+void test_operating_points() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_operating_points " << path.c_str() << std::endl;
+   for (const PartialDRT::OperatingPoint &point: PartialDRT::operating_points()) {
+      PartialDRT::Context context(point);
+      double time = Halide::Tools::benchmark(2, 100, [&]() {
+         context.run(input);
+      });
+      std::cout << "Time_" << point.name << " (tile " << point.tile_size << ", stride " << point.stride << "): "
+                << time * 1e3 << " ms, " << context.detect(input).size() << " detections" << std::endl;
+      Halide::Tools::save_image(context.run(input),
+                                std::string(OUTPUT_DIR) + "output_image_" + point.name + ".png");
+   }
+}
+
+// Thresholds the PS DRT relative to a moving average over the frames, in one pass with the bar detector. On a still
+// image the average is the strongest square of the frame, so the mask matches the two-pass one
+void test_single_pass() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_single_pass " << path.c_str() << std::endl;
+   const PartialDRT::OperatingPoint &point = *PartialDRT::find("ps");
+   PartialDRT::Context two_pass(point), single_pass(point);
+   single_pass.set_normalization(PartialDRT::Normalization::moving_average, 0.25f);
+   double time_two_pass = Halide::Tools::benchmark(2, 100, [&]() {
+      two_pass.run_planes(input);
+   });
+   double time_single_pass = Halide::Tools::benchmark(2, 100, [&]() {
+      single_pass.run_planes(input);
+   });
+   const Detections::Planes &expected = two_pass.run_planes(input);
+   const Detections::Planes &planes = single_pass.run_planes(input);
+   bool same = same_output(expected.mask, planes.mask);
+   std::cout << "Time_ps_two_pass: " << time_two_pass * 1e3 << " ms, Time_ps_single_pass: " << time_single_pass * 1e3
+             << " ms, " << (same ? "same mask" : "DIFFERENT MASK") << "." << std::endl;
+   // A weight of 0 would freeze the average, and a fixed intensity of 0 would fall back to per-frame normalization
+   if (single_pass.set_normalization(PartialDRT::Normalization::moving_average, 0) ||
+       single_pass.set_normalization(PartialDRT::Normalization::fixed, 0)) {
+      std::cout << "Out of range normalization ACCEPTED." << std::endl;
+      n_failures++;
+   }
+}
+
+// Prints the regions found by the MDD and PS detectors
+void test_detections() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   std::cout << "test_detections " << path.c_str() << std::endl;
+   MDDDRT::Context mdd_context;
+   PSDRT::Context ps_context;
+   double time_mdd = Halide::Tools::benchmark(2, 100, [&]() {
+      mdd_context.detect(input);
+   });
+   std::cout << "Time_mdd_detect: " << time_mdd * 1e3 << " ms." << std::endl;
+   for (const auto &detections: {mdd_context.detect(input), ps_context.detect(input)}) {
+      std::cout << detections.size() << " detections" << std::endl;
+      for (const Detections::Detection &detection: detections)
+         std::cout << "  box (" << detection.x_min << ", " << detection.y_min << ") - (" << detection.x_max << ", "
+                   << detection.y_max << "), angle " << detection.angle << ", score " << detection.score
+                   << ", area " << detection.area << std::endl;
+   }
+}
+
+// Runs one MDD context per hardware thread, each on its own stream of frames
+void test_mdd_concurrent() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   int n_threads = std::max(1u, std::thread::hardware_concurrency());
+   int n_frames = 20;
+   std::cout << "test_mdd_concurrent " << n_threads << " threads" << std::endl;
+   std::vector<MDDDRT::Context> contexts(n_threads);
+   double time_mdd = Halide::Tools::benchmark(1, 1, [&]() {
+      std::vector<std::thread> workers;
+      for (int t = 0; t < n_threads; t++) {
+         workers.emplace_back([&, t]() {
+            for (int i = 0; i < n_frames; i++)
+               contexts[t].run(input);
+         });
+      }
+      for (auto &worker: workers)
+         worker.join();
+   });
+   std::cout << "Throughput_mdd: " << n_threads * n_frames / time_mdd << " frames/s." << std::endl;
+}
+
+// Runs the MDD DRT on Halide's thread pool, then on work-stealing pools of one and of every hardware thread, and
+// compares the outputs
+void test_thread_pool() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   int n_threads = std::max(1u, std::thread::hardware_concurrency());
+   std::cout << "test_thread_pool " << n_threads << " threads" << std::endl;
+   MDDDRT::Context reference_context, context;
+   auto reference = reference_context.run(input);
+   double time_halide = Halide::Tools::benchmark(2, 20, [&]() {
+      context.run(input);
+   });
+   std::cout << "Time_mdd_halide_pool: " << time_halide * 1e3 << " ms." << std::endl;
+   for (int threads: {1, n_threads}) {
+      ThreadPool::Options options;
+      options.n_threads = threads;
+      ThreadPool::install(options);
+      double time_pool = Halide::Tools::benchmark(2, 20, [&]() {
+         context.run(input);
+      });
+      auto output = context.run(input);
+      bool same = same_output(reference, output);
+      std::cout << "Time_mdd_pool_" << threads << ": " << time_pool * 1e3 << " ms, "
+                << (same ? "same output" : "DIFFERENT OUTPUT") << "." << std::endl;
+   }
+   ThreadPool::uninstall();
+}
+
+// Eight synthetic 30 fps streams on one detection server, the last two with a tighter latency budget
+void test_detection_server() {
+   int n_streams = 8, n_frames = 60;
+   std::cout << "test_detection_server " << n_streams << " streams" << std::endl;
+   DetectionServer::Server server;
+   for (int i = 0; i < n_streams; i++) {
+      DetectionServer::StreamOptions options;
+      options.deadline_ms = i < 6 ? 100 : 50;
+      server.add_stream(options);
+   }
+   std::vector<std::thread> cameras;
+   for (int i = 0; i < n_streams; i++) {
+      cameras.emplace_back([&server, i, n_frames]() {
+         FrameStream::SyntheticSource source;
+         Halide::Runtime::Buffer<uint8_t> frame(1024, 1024);
+         auto start = FrameStream::Clock::now();
+         for (int f = 0; f < n_frames; f++) {
+            source.read(frame);
+            server.submit(i, frame);
+            std::this_thread::sleep_until(start + std::chrono::microseconds(33333 * (f + 1)));
+         }
+      });
+   }
+   for (std::thread &camera: cameras)
+      camera.join();
+   server.drain();
+   std::cout << server.dump(false);
+   // Once drained, every frame is accounted for
+   for (int i = 0; i < n_streams; i++) {
+      DetectionServer::Metrics metrics = server.metrics(i);
+      if (metrics.processed + metrics.dropped != metrics.submitted) {
+         std::cout << "Stream " << i << ": FRAMES LOST." << std::endl;
+         n_failures++;
+      }
+   }
+}
+
+#ifdef WITH_BATCH
+// Runs the batched MDD libraries on a stack of copies of the input image
+void test_mdd_batch() {
+   Halide::Runtime::Buffer<uint8_t> input = Halide::Tools::load_image(path);
+   int n_frames = 8;
+   Halide::Runtime::Buffer<uint8_t> frames(input.width(), input.height(), n_frames);
+   for (int i = 0; i < n_frames; i++)
+      frames.sliced(2, i).copy_from(input);
+   std::cout << "test_mdd_batch " << n_frames << " frames" << std::endl;
+   MDDDRT::Context context;
+   double time_mdd = Halide::Tools::benchmark(2, 10, [&]() {
+      context.run_batch(frames);
+   });
+   std::cout << "Throughput_mdd_batch: " << n_frames / time_mdd << " frames/s." << std::endl;
+}
+#endif
+
 void test_all() {
    test_pdrt2();
    test_pdrt32();
    test_mdd();
+   test_mdd_graph();
+   test_mdd_incremental();
+   test_mdd_fused();
    test_ps();
+   test_detections();
+   test_operating_points();
+   test_single_pass();
+   test_frame_formats();
+   test_run_into();
+   test_mdd_arena();
+   test_sparse_unpool();
+   test_preprocess();
+   test_roi();
+   test_cascade();
+   test_mdd_concurrent();
+   test_thread_pool();
+   test_detection_server();
+#ifdef WITH_BATCH
+   test_mdd_batch();
+#endif
 }
 
 int main() {
+   std::cout << "CPU variant: " << CpuDispatch::name(CpuDispatch::selected()) << std::endl;
    test_all();
+   std::cout << Instrumentation::dump();
+   if (n_failures > 0) {
+      std::cout << n_failures << " comparisons FAILED." << std::endl;
+      return 1;
+   }
    return 0;
 }
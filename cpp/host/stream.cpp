@@ -0,0 +1,71 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include "../common/frame_stream.h"
+#include "../common/multiscale_domain_detector_drt.h"
+
+const char *usage = "Usage: barcode_segmentation_stream [--raw <file> <width> <height> [--loop]] [--depth <n>] "
+                    "[--fps <f>] [--frames <n>] [--incremental]";
+
+// Streams frames through the MDD DRT, capture and processing overlapping on two threads. Without --raw, synthetic
+// 1024x1024 frames are used. --fps 0 captures as fast as possible. --incremental only recomputes the tiles that changed
+// since the previous frame.
+int main(int argc, char **argv) {
+   std::string raw_path;
+   int width = 1024, height = 1024;
+   int depth = 2;
+   double fps = 30;
+   int n_frames = 300;
+   bool loop = false;
+   bool incremental = false;
+   for (int i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "--raw") && i + 3 < argc) {
+         raw_path = argv[++i];
+         width = atoi(argv[++i]);
+         height = atoi(argv[++i]);
+      } else if (!strcmp(argv[i], "--loop")) {
+         loop = true;
+      } else if (!strcmp(argv[i], "--depth") && i + 1 < argc) {
+         depth = atoi(argv[++i]);
+      } else if (!strcmp(argv[i], "--fps") && i + 1 < argc) {
+         fps = atof(argv[++i]);
+      } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+         n_frames = atoi(argv[++i]);
+      } else if (!strcmp(argv[i], "--incremental")) {
+         incremental = true;
+      } else {
+         std::cerr << "Unknown argument " << argv[i] << std::endl << usage << std::endl;
+         return 1;
+      }
+   }
+   if (width <= 0 || height <= 0 || depth < 1) {
+      std::cerr << "The frame size must be positive and the depth at least 1" << std::endl << usage << std::endl;
+      return 1;
+   }
+
+   std::unique_ptr<FrameStream::FrameSource> source;
+   if (raw_path.empty())
+      source = std::make_unique<FrameStream::SyntheticSource>();
+   else
+      source = std::make_unique<FrameStream::RawFileSource>(raw_path, loop);
+
+   // Weights and threshold used by python/camera.py
+   MDDDRT::Context context;
+   auto statistics = FrameStream::run(*source, width, height, depth, fps, n_frames,
+                                      [&](Halide::Runtime::Buffer<uint8_t> &frame) {
+                                         if (incremental)
+                                            context.run_incremental(frame, 0.05, 0.527, 0.33, 0.76, 0.84, 0.84,
+                                                                    1.16, 3.47, 1);
+                                         else
+                                            context.run(frame, 0.05, 0.527, 0.33, 0.76, 0.84, 0.84, 1.16, 3.47, 1);
+                                      });
+
+   std::cout << "Captured: " << statistics.captured << " frames, processed: " << statistics.processed
+             << ", dropped: " << statistics.dropped << std::endl;
+   std::cout << "Sustained: " << statistics.fps << " frames/s." << std::endl;
+   std::cout << "Latency: mean " << statistics.latency_mean << " ms, p50 " << statistics.latency_p50 << " ms, p95 "
+             << statistics.latency_p95 << " ms, max " << statistics.latency_max << " ms." << std::endl;
+   return 0;
+}
@@ -0,0 +1,167 @@
+"""Thin binding of the Halide/C++ detectors (../cpp/host/api.cpp).
+
+Images go to the library as numpy arrays, without copies, and the detectors write into arrays owned by the caller
+(the *_into entry points), so a result stays valid until the caller overwrites it. The library is loaded with
+ctypes.CDLL, which releases the GIL for the duration of each call: threads each holding their own detectors run
+at the same time as capture, decoding or other Python work.
+"""
+import ctypes
+import numpy as np
+
+DEFAULT_LIBRARY = '../cpp/build/host/libbarcode_segmentation_lib.so'
+MDD_WEIGHTS = [0.05, 0.527, 0.33, 0.76, 0.84, 0.84, 1.16, 3.47]
+
+# Pixel formats of the raw camera frames, FrameFormat::PixelFormat
+Y8, NV12, YUYV, UYVY, BGR24 = range(5)
+# Threshold normalization of the partial strided DRT detectors, PartialDRT::Normalization
+PER_FRAME, MOVING_AVERAGE, FIXED = range(3)
+
+_image = np.ctypeslib.ndpointer(dtype=np.uint8, ndim=2, flags='C_CONTIGUOUS')
+_planes = np.ctypeslib.ndpointer(dtype=np.uint8, ndim=3, flags='C_CONTIGUOUS')
+_int = ctypes.c_int
+_double = ctypes.c_double
+
+
+def load(libname: str = DEFAULT_LIBRARY) -> ctypes.CDLL:
+    clib = ctypes.CDLL(libname)
+    for name in ['mdd_drt', 'mdd_fused', 'ps_drt', 'pdrt2', 'pdrt32', 'partial_drt', 'preprocess']:
+        getattr(clib, f'{name}_context_create').restype = ctypes.c_void_p
+        getattr(clib, f'{name}_context_destroy').argtypes = [ctypes.c_void_p]
+    clib.partial_drt_context_create.argtypes = [_int, _int]
+    for name in ['mdd_drt', 'ps_drt', 'pdrt2', 'pdrt32']:
+        getattr(clib, f'{name}_output_size').argtypes = [_int, _int, ctypes.POINTER(_int), ctypes.POINTER(_int)]
+    clib.partial_drt_output_size.argtypes = [_int, _int, _int, _int, ctypes.POINTER(_int), ctypes.POINTER(_int)]
+    for name in ['mdd_drt', 'mdd_fused']:
+        function = getattr(clib, f'run_{name}_context_into')
+        function.restype = _int
+        function.argtypes = [ctypes.c_void_p, _image, _int, _int, _planes, _int, _int] + [_double] * 9
+    for name in ['ps_drt', 'pdrt2', 'pdrt32', 'partial_drt']:
+        function = getattr(clib, f'run_{name}_context_into')
+        function.restype = _int
+        function.argtypes = [ctypes.c_void_p, _image, _int, _int, _planes, _int, _int]
+        function = getattr(clib, f'{name}_context_set_normalization')
+        function.restype = _int
+        function.argtypes = [ctypes.c_void_p, _int, ctypes.c_float]
+    clib.thread_pool_install.restype = _int
+    clib.thread_pool_install.argtypes = [_int, ctypes.POINTER(_int), _int, _int]
+    clib.run_preprocess_context.restype = ctypes.POINTER(ctypes.c_uint8)
+    clib.run_preprocess_context.argtypes = [ctypes.c_void_p, ctypes.c_void_p, _int, _int, _int, _int, _int, _int]
+    return clib
+
+
+def install_thread_pool(clib: ctypes.CDLL, n_threads: int = 0, cpus=(), priority: int = 0):
+    """Runs the detectors on a work-stealing pool of n_threads threads (0 for one per hardware thread), the workers
+    pinned in turn to `cpus` and running at the `priority` nice value. Not while a detector runs"""
+    cpu_array = (_int * len(cpus))(*cpus)
+    if clib.thread_pool_install(n_threads, cpu_array, len(cpus), priority) != 0:
+        raise ValueError(f'Invalid thread pool options {n_threads}, {cpus}, {priority}')
+
+
+def to_bgr(planes: np.ndarray) -> np.ndarray:
+    """(height, width, 3) view of a (3, height, width) result, for OpenCV. The planes are already B, G and R"""
+    return np.moveaxis(planes, 0, 2)
+
+
+class Detector:
+    """One context of the library. Not thread-safe: give each thread its own detector"""
+
+    def __init__(self, clib: ctypes.CDLL, name: str, *create_args, size_name: str = None, size_args=()):
+        self.clib = clib
+        self.name = name
+        self.context = getattr(clib, f'{name}_context_create')(*create_args)
+        if not self.context:
+            raise ValueError(f'{name} {create_args} was not built')
+        self.size_function = getattr(clib, f'{size_name or name}_output_size')
+        self.size_args = size_args
+        self.run_function = getattr(clib, f'run_{name}_context_into')
+
+    def __del__(self):
+        if getattr(self, 'context', None):
+            getattr(self.clib, f'{self.name}_context_destroy')(self.context)
+            self.context = None
+
+    def output_shape(self, image_shape) -> (int, int, int):
+        width, height = _int(), _int()
+        self.size_function(*self.size_args, image_shape[1], image_shape[0], ctypes.byref(width), ctypes.byref(height))
+        return 3, height.value, width.value
+
+    def empty_output(self, image_shape) -> np.ndarray:
+        return np.empty(self.output_shape(image_shape), dtype=np.uint8)
+
+    def run(self, image: np.ndarray, out: np.ndarray = None, *args) -> np.ndarray:
+        """Detects on a (height, width) uint8 image. The result is written to `out`, a (3, height, width) uint8 array
+        of B, G and R planes sized by output_shape(), allocated when not given, and returned"""
+        if out is None:
+            out = self.empty_output(image.shape)
+        if self.run_function(self.context, image, image.shape[1], image.shape[0], out, out.shape[2], out.shape[1],
+                             *args) != 0:
+            raise ValueError(f'{self.name}: the output must be {self.output_shape(image.shape)}, not {out.shape}')
+        return out
+
+
+class MDDDRT(Detector):
+    def __init__(self, clib: ctypes.CDLL, fused: bool = False, weights=None, threshold: float = 1):
+        super().__init__(clib, 'mdd_fused' if fused else 'mdd_drt', size_name='mdd_drt')
+        self.weights = MDD_WEIGHTS if weights is None else weights
+        self.threshold = threshold
+
+    def run(self, image: np.ndarray, out: np.ndarray = None, *args) -> np.ndarray:
+        return super().run(image, out, *self.weights, self.threshold)
+
+
+class PartialDetector(Detector):
+    def set_normalization(self, mode: int, value: float = 0):
+        """Thresholds relative to the strongest square of each frame (PER_FRAME), to a moving average over the
+        previous frames with `value` the weight of the newest one, in (0, 1] (MOVING_AVERAGE), or to the fixed
+        intensity `value`, above 0 (FIXED)"""
+        if getattr(self.clib, f'{self.name}_context_set_normalization')(self.context, mode, value) != 0:
+            raise ValueError(f'{self.name}: invalid normalization {mode}, {value}')
+
+
+class PSDRT(PartialDetector):
+    def __init__(self, clib: ctypes.CDLL):
+        super().__init__(clib, 'ps_drt')
+
+
+class PDRT2(PartialDetector):
+    def __init__(self, clib: ctypes.CDLL):
+        super().__init__(clib, 'pdrt2')
+
+
+class PDRT32(PartialDetector):
+    def __init__(self, clib: ctypes.CDLL):
+        super().__init__(clib, 'pdrt32')
+
+
+class PartialDRT(PartialDetector):
+    """Any partial strided DRT operating point that was built"""
+
+    def __init__(self, clib: ctypes.CDLL, tile_size: int, stride: int):
+        super().__init__(clib, 'partial_drt', tile_size, stride, size_args=(tile_size, stride))
+
+
+class Preprocessor:
+    """Resize and contrast stretch of raw camera frames to the working image of the detectors"""
+
+    def __init__(self, clib: ctypes.CDLL, width: int = 1024, height: int = 1024):
+        self.clib = clib
+        self.width = width
+        self.height = height
+        self.context = clib.preprocess_context_create()
+
+    def __del__(self):
+        if getattr(self, 'context', None):
+            self.clib.preprocess_context_destroy(self.context)
+            self.context = None
+
+    def run(self, frame: np.ndarray, pixel_format: int = Y8, x: int = 0, width: int = None) -> np.ndarray:
+        """Preprocesses columns x to x + width of `frame`, in place: a (height, width) Y8 array, or a
+        (height, width, channels) array of another format. The result is owned by the preprocessor and overwritten
+        by its next run"""
+        width = frame.shape[1] - x if width is None else width
+        data = frame.ctypes.data + x * frame.strides[1]
+        result = self.clib.run_preprocess_context(self.context, data, width, frame.shape[0], frame.strides[0],
+                                                  pixel_format, self.width, self.height)
+        if not result:
+            raise ValueError(f'Unknown pixel format {pixel_format}')
+        return np.ctypeslib.as_array(result, shape=(self.height, self.width))
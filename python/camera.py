@@ -1,36 +1,53 @@
-import ctypes
+import queue
+import threading
 import time
 import cv2
-import numpy as np
 import faulthandler
+import barcode_segmentation
 
 faulthandler.enable()
 
-libname = '../cpp/build/host/libbarcode_segmentation_lib.so'
-clib = ctypes.CDLL(libname)
-
-run_mdd_drt = clib.run_mdd_drt
-
-run_mdd_drt.restype = ctypes.POINTER(ctypes.c_uint8 * 512 * 512 * 3)
-run_mdd_drt.argtypes = [np.ctypeslib.ndpointer(dtype=np.dtype('uint8'), shape=(1024, 1024)),
-                        ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_double,
-                        ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_double]
+clib = barcode_segmentation.load()
+# Crop, channel selection, resize and contrast stretch run in the library, on the captured frame in place
+preprocessor = barcode_segmentation.Preprocessor(clib)
+mdd = barcode_segmentation.MDDDRT(clib)
+mdd_result = None
 
 capture = cv2.VideoCapture(0)
 
 capture.set(cv2.CAP_PROP_FRAME_WIDTH, 640)
 capture.set(cv2.CAP_PROP_FPS, 30)
 capture.set(cv2.CAP_PROP_BUFFERSIZE, 1)
+
+# The library calls release the GIL, so the next frame is captured while the current one is detected. Only the
+# newest frame is kept
+frames = queue.Queue(maxsize=1)
+
+
+def capture_frames():
+    while capture.isOpened():
+        ret, frame = capture.read()
+        if not ret:
+            break
+        try:
+            frames.get_nowait()
+        except queue.Empty:
+            pass
+        frames.put(frame)
+    frames.put(None)
+
+
+threading.Thread(target=capture_frames, daemon=True).start()
+
 number_of_frames_elapsed = 0
 last_time = time.time()
-while capture.isOpened():
-    ret, frame = capture.read()
+while True:
+    frame = frames.get()
+    if frame is None:
+        break
     h, w, _ = frame.shape
     crop = (w - h) // 2
-    frame = frame[:, crop:-crop]
-    frame = frame[:, :, 0]
-    cv2.imshow('Input', frame)
-    frame = cv2.resize(frame, (1024, 1024), interpolation=cv2.INTER_LINEAR)
+    cv2.imshow('Input', frame[:, crop:-crop, 0])
 
     number_of_frames_elapsed += 1
     if number_of_frames_elapsed == 50:
@@ -40,17 +57,11 @@ while capture.isOpened():
         last_time = time.time()
         number_of_frames_elapsed = 0
 
-    in_img = np.double(frame)
-    in_img -= in_img.min()
-    in_img /= in_img.max()
-    in_img = np.uint8(255 * in_img)
-    mdd_weights = [0.05, 0.527, 0.33, 0.76, 0.84, 0.84, 1.16, 3.47]
-    mdd_threshold = 1
-    mdd_result = run_mdd_drt(in_img, *mdd_weights, mdd_threshold)
-    mdd_result = np.array(mdd_result.contents)
-    mdd_result = np.moveaxis(mdd_result, 0, 2)
-    mdd_result = cv2.cvtColor(mdd_result, cv2.COLOR_RGB2BGR)
-    cv2.imshow('MDD DRT', mdd_result)
+    in_img = preprocessor.run(frame, barcode_segmentation.BGR24, crop, w - 2 * crop)
+    if mdd_result is None:
+        mdd_result = mdd.empty_output(in_img.shape)
+    mdd.run(in_img, mdd_result)
+    cv2.imshow('MDD DRT', barcode_segmentation.to_bgr(mdd_result))
     cv2.waitKey(1)
 
 capture.release()
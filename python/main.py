@@ -1,11 +1,11 @@
 import argparse
-import ctypes
 import glob
 import math
 import os
 import cv2
 import numpy as np
 from natsort import natsort
+import barcode_segmentation
 import multiscale_domain_detector_drt
 import partial_drt
 import partial_strided_drt
@@ -66,30 +66,20 @@ def run_python_implementation(files: [str]):
 
 def run_halide_implementation(files: [str]):
     print('Running halide implementation')
-    libname = '../cpp/build/host/libbarcode_segmentation_lib.so'
     try:
-        clib = ctypes.CDLL(libname)
+        clib = barcode_segmentation.load()
     except OSError as e:
         print(f'The library was not found. Check the README.md for instructions. {e}')
+        return
 
-    run_mdd_drt = clib.run_mdd_drt
-    run_ps_drt = clib.run_ps_drt
-    run_pdrt2 = clib.run_pdrt2
-    run_pdrt32 = clib.run_pdrt32
-
-    run_mdd_drt.restype = ctypes.POINTER(ctypes.c_uint8 * 512 * 512 * 3)
-    run_mdd_drt.argtypes = [np.ctypeslib.ndpointer(dtype=np.dtype('uint8'), shape=(1024, 1024)),
-                            ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_double,
-                            ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_double]
-
-    run_ps_drt.restype = ctypes.POINTER(ctypes.c_uint8 * 497 * 497 * 3)
-    run_ps_drt.argtypes = [np.ctypeslib.ndpointer(dtype=np.dtype('uint8'), shape=(1024, 1024))]
-
-    run_pdrt2.restype = ctypes.POINTER(ctypes.c_uint8 * 512 * 512 * 3)
-    run_pdrt2.argtypes = [np.ctypeslib.ndpointer(dtype=np.dtype('uint8'), shape=(1024, 1024))]
-
-    run_pdrt32.restype = ctypes.POINTER(ctypes.c_uint8 * 32 * 32 * 3)
-    run_pdrt32.argtypes = [np.ctypeslib.ndpointer(dtype=np.dtype('uint8'), shape=(1024, 1024))]
+    # Resize and contrast stretch, in one library stage
+    preprocessor = barcode_segmentation.Preprocessor(clib)
+    mdd = barcode_segmentation.MDDDRT(clib)
+    ps = barcode_segmentation.PSDRT(clib)
+    pdrt2 = barcode_segmentation.PDRT2(clib)
+    pdrt32 = barcode_segmentation.PDRT32(clib)
+    # The detectors write into these arrays, reused for every image of the same size
+    outputs = {}
 
     for file in files:
         image_name = os.path.basename(file).split('.')[0]
@@ -97,47 +87,32 @@ def run_halide_implementation(files: [str]):
         in_img = cv2.imread(file, cv2.IMREAD_GRAYSCALE)
         if in_img.shape[0] != 1024:
             print(f'Warning: input image {image_name} is not 1024x1024. Resizing.')
-            in_img = cv2.resize(in_img, (1024, 1024))
-        in_img = np.double(in_img)
-        in_img -= in_img.min()
-        in_img /= in_img.max()
-        in_img = np.uint8(255 * in_img)
-        mdd_weights = [0.05, 0.527, 0.33, 0.76, 0.84, 0.84, 1.16, 3.47]
-        mdd_threshold = 1
-        mdd_result = run_mdd_drt(in_img, *mdd_weights, mdd_threshold)
-        mdd_result = np.array(mdd_result.contents)
-        mdd_result = np.moveaxis(mdd_result, 0, 2)
-        mdd_result = cv2.cvtColor(mdd_result, cv2.COLOR_RGB2BGR)
-
-        ps_result = run_ps_drt(in_img)
-        ps_result = np.array(ps_result.contents)
-        ps_result = np.moveaxis(ps_result, 0, 2)
+        in_img = preprocessor.run(in_img)
+        if not outputs:
+            outputs = {detector: detector.empty_output(in_img.shape) for detector in [mdd, ps, pdrt2, pdrt32]}
+
+        mdd_result = barcode_segmentation.to_bgr(mdd.run(in_img, outputs[mdd]))
+
+        ps_result = barcode_segmentation.to_bgr(ps.run(in_img, outputs[ps]))
         ps_result[0:5, :, :] = 0
         ps_result[:, 0:5, :] = 0
         ps_result[-5:, :, :] = 0
         ps_result[:, -5:, :] = 0
-        ps_result = cv2.cvtColor(ps_result, cv2.COLOR_RGB2BGR)
         border_size = (512 - 497) // 2 + 1
         ps_result = cv2.copyMakeBorder(ps_result, border_size, border_size, border_size, border_size,
                                        borderType=cv2.BORDER_CONSTANT)
 
-        pdrt2_result = run_pdrt2(in_img)
-        pdrt2_result = np.array(pdrt2_result.contents)
-        pdrt2_result = np.moveaxis(pdrt2_result, 0, 2)
+        pdrt2_result = barcode_segmentation.to_bgr(pdrt2.run(in_img, outputs[pdrt2]))
         pdrt2_result[0, :, :] = 0
         pdrt2_result[:, 0, :] = 0
         pdrt2_result[-1, :, :] = 0
         pdrt2_result[:, -1, :] = 0
-        pdrt2_result = cv2.cvtColor(pdrt2_result, cv2.COLOR_RGB2BGR)
 
-        pdrt32_result = run_pdrt32(in_img)
-        pdrt32_result = np.array(pdrt32_result.contents)
-        pdrt32_result = np.moveaxis(pdrt32_result, 0, 2)
+        pdrt32_result = barcode_segmentation.to_bgr(pdrt32.run(in_img, outputs[pdrt32]))
         pdrt32_result[0, :, :] = 0
         pdrt32_result[:, 0, :] = 0
         pdrt32_result[-1, :, :] = 0
         pdrt32_result[:, -1, :] = 0
-        pdrt32_result = cv2.cvtColor(pdrt32_result, cv2.COLOR_RGB2BGR)
         pdrt32_result = cv2.resize(pdrt32_result, (512, 512), interpolation=cv2.INTER_NEAREST_EXACT)
 
         os.makedirs('out', exist_ok=True)